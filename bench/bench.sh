@@ -0,0 +1,125 @@
+#!/bin/sh
+# Copyright (c) 2005-2009 Bart Massey
+# ALL RIGHTS RESERVED
+# Please see the file COPYING in this directory for license information.
+
+# Benchmark simhash on a synthetic corpus from gencorpus:
+# hashing throughput across shingle, feature set and
+# signature sizes and for shingles of words, score()
+# throughput, and -m end to end as the number of files
+# grows.  Run from the top of the source tree, as "make
+# bench" does.  Results go to standard
+# output one per line, tab-separated, as
+#
+#   benchmark  parameters  value  unit
+#
+# with comment lines starting with #.  The environment
+# may set BENCH_MB (size of each hashing input, default
+# 64), BENCH_N (most files for -m, default 4000),
+# BENCH_REPS (runs of each timing, best taken, default
+# 3) and BENCH_DIR (scratch directory, default a new
+# one in /tmp, removed at the end).
+
+SIMHASH=${SIMHASH:-./simhash}
+GENCORPUS=${GENCORPUS:-bench/gencorpus}
+MB=${BENCH_MB:-64}
+MAXN=${BENCH_N:-4000}
+REPS=${BENCH_REPS:-3}
+if [ -n "$BENCH_DIR" ]; then
+  DIR=$BENCH_DIR
+  mkdir -p "$DIR" || exit 1
+else
+  DIR=`mktemp -d /tmp/simbench.XXXXXX` || exit 1
+  trap 'rm -rf "$DIR"' 0
+  trap 'exit 1' 1 2 15
+fi
+
+now() {
+  date +%s.%N
+}
+
+# best wall time of REPS runs of the command, in seconds
+best() {
+  BEST=""
+  i=0
+  while [ $i -lt $REPS ]; do
+    T0=`now`
+    "$@" > /dev/null || return 1
+    T1=`now`
+    BEST=`awk -v a=$T0 -v b=$T1 -v best="$BEST" \
+      'BEGIN { t = b - a; if (best == "" || t < best) best = t; print best }'`
+    i=`expr $i + 1`
+  done
+  echo $BEST
+}
+
+report() {
+  printf '%s\t%s\t%s\t%s\n' "$1" "$2" "$3" "$4"
+}
+
+echo "# simhash benchmark"
+echo "# host `uname -n` `uname -m`, `date -u +%Y-%m-%dT%H:%M:%SZ`"
+echo "# benchmark	parameters	value	unit"
+
+# hashing throughput
+BYTES=`expr $MB \* 1048576`
+for KIND in random text repetitive; do
+  $GENCORPUS -k $KIND -b $BYTES > $DIR/$KIND || exit 1
+  for S in 4 8 16; do
+    for F in 64 128 1024; do
+      T=`best $SIMHASH -s $S -f $F $DIR/$KIND`
+      report hash "kind=$KIND s=$S f=$F" \
+        `awk -v n=$BYTES -v t=$T 'BEGIN { printf "%.3f", n / t / 1e9 }'` GB/s
+    done
+    for B in 64 128; do
+      T=`best $SIMHASH -s $S --mode bitsig --bits $B $DIR/$KIND`
+      report hash "kind=$KIND s=$S bitsig=$B" \
+        `awk -v n=$BYTES -v t=$T 'BEGIN { printf "%.3f", n / t / 1e9 }'` GB/s
+    done
+  done
+  # shingles of words, on the same bytes
+  for W in 1 4 8; do
+    T=`best $SIMHASH --tokens $W $DIR/$KIND`
+    report hash "kind=$KIND tokens=$W" \
+      `awk -v n=$BYTES -v t=$T 'BEGIN { printf "%.3f", n / t / 1e9 }'` GB/s
+  done
+  rm -f $DIR/$KIND
+done
+
+# score() throughput, plain, delta coded and for
+# signatures: --top scores every pair, and its output is
+# small
+N=2000
+mkdir -p $DIR/score
+$GENCORPUS -k neardup -n $N -b 16384 -e 0.05 $DIR/score || exit 1
+for F in 64 128 1024; do
+  $SIMHASH -f $F -w --pack $DIR/score-$F.simpack $DIR/score/* || exit 1
+  T=`best $SIMHASH -m --top 1 --pack $DIR/score-$F.simpack`
+  report score "n=$N f=$F" \
+    `awk -v n=$N -v t=$T 'BEGIN { printf "%.0f", n * (n - 1) / 2 / t }'` pairs/s
+  $SIMHASH -f $F --compress -w --pack $DIR/score-$F.simpack $DIR/score/* ||
+    exit 1
+  T=`best $SIMHASH -m --top 1 --pack $DIR/score-$F.simpack`
+  report score "n=$N f=$F coded" \
+    `awk -v n=$N -v t=$T 'BEGIN { printf "%.0f", n * (n - 1) / 2 / t }'` pairs/s
+done
+for B in 64 128; do
+  $SIMHASH --mode bitsig --bits $B -w --pack $DIR/score-$B.simpack \
+    $DIR/score/* || exit 1
+  T=`best $SIMHASH -m --top 1 --pack $DIR/score-$B.simpack`
+  report score "n=$N bitsig=$B" \
+    `awk -v n=$N -v t=$T 'BEGIN { printf "%.0f", n * (n - 1) / 2 / t }'` pairs/s
+done
+rm -rf $DIR/score $DIR/score-*.simpack
+
+# -m end to end, hashing and matching, as n doubles
+mkdir -p $DIR/match
+$GENCORPUS -k neardup -n $MAXN -b 8192 -e 0.05 $DIR/match || exit 1
+N=250
+while [ $N -le $MAXN ]; do
+  FILES=`ls -d $DIR/match/* | head -n $N`
+  T=`best $SIMHASH -m $FILES`
+  report match "n=$N" $T s
+  N=`expr $N \* 2`
+done
+rm -rf $DIR/match
@@ -0,0 +1,146 @@
+/*
+ * Copyright © 2005-2009 Bart Massey
+ * ALL RIGHTS RESERVED
+ * [This program is licensed under the "3-clause ('new') BSD License"]
+ * Please see the file COPYING in the source
+ * distribution of this software for license terms.
+ */
+
+/*
+ * Microbenchmark of the feature set: the old binary heap
+ * plus tombstone hash stop list against bottomk, for a
+ * range of feature counts.  Each stream is fed to both,
+ * and both must end up with the same set.
+ */
+
+#define _GNU_SOURCE
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include "oldheap.h"
+#include "../bottomk.h"
+
+/* values per stream */
+#define NVALUES (1 << 24)
+
+static unsigned *values;
+static int nvalues;
+
+static unsigned xorshift(unsigned *s) {
+    unsigned x = *s;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    return *s = x;
+}
+
+static struct stream {
+    char *name;
+    int nvalues;
+} streams[] = {
+    {"random", NVALUES},
+    {"dups", NVALUES},
+    /* the old stop list is very slow here */
+    {"falling", NVALUES >> 6}
+};
+#define NSTREAMS ((int) (sizeof streams / sizeof streams[0]))
+
+/* "random" is all-distinct-looking hashes, as from
+   incompressible input; "dups" draws from a small pool,
+   as from repetitive input; "falling" trends downward,
+   so that most values evict the largest */
+static void make_values(int stream) {
+    unsigned s = 2463534242U;
+    int i;
+    nvalues = streams[stream].nvalues;
+    for (i = 0; i < nvalues; i++) {
+	unsigned v = xorshift(&s);
+	if (stream == 1)
+	    v = (v % 4096) * 2654435761U;
+	else if (stream == 2)
+	    v = ~((unsigned) i << 8) - (v & 0xffff);
+	values[i] = v;
+    }
+}
+
+static double now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+/* the stop list and heap, as sketch.c used them */
+static void old_insert(heap *h, hashtab *stop, int k, unsigned v) {
+    if (hash_contains(stop, v))
+	return;
+    if (h->n == k) {
+	unsigned m = heap_extract_max(h);
+	hash_delete(stop, m);
+    }
+    hash_insert(stop, v);
+    heap_insert(h, v);
+}
+
+static int cmp_unsigned(const void *a, const void *b) {
+    unsigned x = *(const unsigned *)a;
+    unsigned y = *(const unsigned *)b;
+    return (x > y) - (x < y);
+}
+
+static void run(const char *name, int k) {
+    static heap h;
+    static hashtab stop;
+    static bottomk b;
+    unsigned *x, *y;
+    double t0, t_old, t_new;
+    int i, n;
+    heap_reset(&h, k);
+    hash_reset(&stop, k);
+    bottomk_reset(&b, k);
+    t0 = now();
+    /* both reject unwanted values inline, as sketch.c does */
+    for (i = 0; i < nvalues; i++)
+	if (h.n < k || values[i] < h.v[0])
+	    old_insert(&h, &stop, k, values[i]);
+    t_old = now() - t0;
+    t0 = now();
+    for (i = 0; i < nvalues; i++)
+	if (BOTTOMK_WANTED(&b, values[i]))
+	    bottomk_insert(&b, values[i]);
+    t_new = now() - t0;
+    assert(h.n == b.n);
+    n = h.n;
+    x = malloc(n * sizeof x[0]);
+    y = malloc(n * sizeof y[0]);
+    assert(x && y);
+    for (i = 0; i < n; i++) {
+	x[i] = h.v[i];
+	y[i] = b.heap[i];
+    }
+    qsort(x, n, sizeof x[0], cmp_unsigned);
+    qsort(y, n, sizeof y[0], cmp_unsigned);
+    for (i = 0; i < n; i++)
+	assert(x[i] == y[i]);
+    free(x);
+    free(y);
+    printf("%-6s %5d %8.2f %8.2f %6.2fx\n", name, k,
+	   t_old * 1e9 / nvalues, t_new * 1e9 / nvalues, t_old / t_new);
+}
+
+/* Every value goes through the whole insert, as on the
+   scalar path before the heap fills or with -d; the
+   vector kernels filter most of them out first. */
+int main(void) {
+    int stream, k;
+    values = malloc(NVALUES * sizeof values[0]);
+    assert(values);
+    printf("%-6s %5s %8s %8s %7s\n",
+	   "stream", "k", "old ns", "new ns", "speedup");
+    for (stream = 0; stream < NSTREAMS; stream++) {
+	make_values(stream);
+	for (k = 128; k <= 8192; k *= 2)
+	    run(streams[stream].name, k);
+    }
+    return 0;
+}
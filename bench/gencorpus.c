@@ -0,0 +1,228 @@
+/*
+ * Copyright © 2005-2009 Bart Massey
+ * ALL RIGHTS RESERVED
+ * [This program is licensed under the "3-clause ('new') BSD License"]
+ * Please see the file COPYING in the source
+ * distribution of this software for license terms.
+ */
+
+/*
+ * Deterministic synthetic corpus for benchmarks.  The
+ * same arguments always give the same bytes.
+ *
+ *   gencorpus [-k kind] [-b bytes] [-n nfiles] [-m members]
+ *             [-e rate] [-r seed] [dir]
+ *
+ * With a directory, write nfiles files of about bytes
+ * bytes each into it, named 00000, 00001, ...; without,
+ * write one such file to standard output.  The kinds are
+ *
+ *   random      uniformly random bytes
+ *   text        words from a skewed synthetic vocabulary,
+ *               in lines
+ *   repetitive  a short random block over and over, with
+ *               rare changes
+ *   neardup     families of members files of text, each
+ *               a copy of the family's first with a
+ *               fraction rate of its bytes edited
+ */
+
+#define _GNU_SOURCE
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+/* words in the text vocabulary */
+#define NWORDS 4096
+/* longest line of text */
+#define LINE 72
+
+static unsigned seed = 2463534242U;
+
+static unsigned xorshift(void) {
+    seed ^= seed << 13;
+    seed ^= seed >> 17;
+    seed ^= seed << 5;
+    return seed;
+}
+
+static char *words[NWORDS];
+
+/* words of 1 to 12 letters, shorter ones commoner */
+static void make_words(void) {
+    unsigned s = seed;
+    int i, j;
+    seed = 88172645U;
+    for (i = 0; i < NWORDS; i++) {
+	int n = 1 + xorshift() % 6 + xorshift() % 7;
+	words[i] = malloc(n + 1);
+	assert(words[i]);
+	for (j = 0; j < n; j++)
+	    words[i][j] = 'a' + xorshift() % 26;
+	words[i][n] = '\0';
+    }
+    seed = s;
+}
+
+static void gen_random(unsigned char *p, size_t n) {
+    size_t i;
+    for (i = 0; i < n; i++)
+	p[i] = xorshift();
+}
+
+/* The lower of two draws skews toward the front of the
+   vocabulary, roughly as word frequencies do. */
+static void gen_text(unsigned char *p, size_t n) {
+    size_t i = 0;
+    int col = 0;
+    while (i < n) {
+	unsigned a = xorshift() % NWORDS;
+	unsigned b = xorshift() % NWORDS;
+	char *w = words[a < b ? a : b];
+	size_t len = strlen(w);
+	if (col + len + 1 > LINE) {
+	    p[i++] = '\n';
+	    col = 0;
+	    continue;
+	}
+	if (col > 0) {
+	    p[i++] = xorshift() % 16 ? ' ' : (xorshift() % 2 ? ',' : '.');
+	    col++;
+	}
+	while (*w && i < n) {
+	    p[i++] = *w++;
+	    col++;
+	}
+    }
+}
+
+static void gen_repetitive(unsigned char *p, size_t n) {
+    size_t block = 64 + xorshift() % 4033;
+    size_t i;
+    gen_random(p, block < n ? block : n);
+    for (i = block; i < n; i++)
+	p[i] = xorshift() % 4096 ? p[i - block] : xorshift();
+}
+
+/* Copy the n bytes of base into p, substituting,
+   inserting or deleting at a fraction rate of them. */
+static size_t gen_edit(unsigned char *p, size_t nalloc,
+		       const unsigned char *base, size_t n, double rate) {
+    unsigned limit = rate * 4294967295.0;
+    size_t i = 0, j = 0;
+    while (i < n && j < nalloc) {
+	if (xorshift() >= limit) {
+	    p[j++] = base[i++];
+	    continue;
+	}
+	switch (xorshift() % 3) {
+	case 0:
+	    p[j++] = 'a' + xorshift() % 26;
+	    i++;
+	    break;
+	case 1:
+	    p[j++] = 'a' + xorshift() % 26;
+	    break;
+	case 2:
+	    i++;
+	    break;
+	}
+    }
+    return j;
+}
+
+static void write_out(char *name, unsigned char *p, size_t n) {
+    FILE *f = name ? fopen(name, "w") : stdout;
+    if (!f || fwrite(p, 1, n, f) != n || (name && fclose(f) == EOF)) {
+	perror(name ? name : "stdout");
+	exit(1);
+    }
+}
+
+static void usage(void) {
+    fprintf(stderr, "gencorpus: usage: gencorpus "
+	    "[-k random|text|repetitive|neardup] [-b bytes] [-n nfiles]\n"
+	    "\t[-m members] [-e rate] [-r seed] [dir]\n");
+    exit(1);
+}
+
+int main(int argc, char **argv) {
+    char *kind = "text";
+    size_t nbytes = 64 * 1024;
+    int nfiles = 1;
+    int members = 4;
+    double rate = 0.05;
+    char *dir = 0;
+    unsigned char *buf, *base;
+    size_t nalloc;
+    int c, i;
+    while ((c = getopt(argc, argv, "k:b:n:m:e:r:")) != -1) {
+	switch (c) {
+	case 'k':
+	    kind = optarg;
+	    break;
+	case 'b':
+	    nbytes = strtoul(optarg, 0, 10);
+	    break;
+	case 'n':
+	    nfiles = atoi(optarg);
+	    break;
+	case 'm':
+	    members = atoi(optarg);
+	    break;
+	case 'e':
+	    rate = atof(optarg);
+	    break;
+	case 'r':
+	    seed = strtoul(optarg, 0, 10);
+	    if (seed == 0)
+		usage();
+	    break;
+	default:
+	    usage();
+	}
+    }
+    if (optind < argc)
+	dir = argv[optind++];
+    if (optind != argc || nbytes < 1 || nfiles < 1 || members < 1 ||
+	rate < 0 || rate > 1)
+	usage();
+    if (!dir)
+	nfiles = 1;
+    if (strcmp(kind, "random") && strcmp(kind, "text") &&
+	strcmp(kind, "repetitive") && strcmp(kind, "neardup"))
+	usage();
+    make_words();
+    /* room for an edited copy that grew */
+    nalloc = nbytes + nbytes / 2 + 1;
+    buf = malloc(nalloc);
+    base = malloc(nbytes);
+    assert(buf && base);
+    for (i = 0; i < nfiles; i++) {
+	char name[4096];
+	size_t n = nbytes;
+	if (!strcmp(kind, "random")) {
+	    gen_random(buf, n);
+	} else if (!strcmp(kind, "text")) {
+	    gen_text(buf, n);
+	} else if (!strcmp(kind, "repetitive")) {
+	    gen_repetitive(buf, n);
+	} else if (i % members == 0) {
+	    gen_text(base, n);
+	    memcpy(buf, base, n);
+	} else {
+	    n = gen_edit(buf, nalloc, base, n, rate);
+	}
+	if (dir) {
+	    if (strlen(dir) > sizeof name - 16)
+		usage();
+	    sprintf(name, "%s/%05d", dir, i);
+	    write_out(name, buf, n);
+	} else {
+	    write_out(0, buf, n);
+	}
+    }
+    return 0;
+}
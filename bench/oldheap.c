@@ -0,0 +1,271 @@
+/*
+ * Copyright © 2005-2009 Bart Massey
+ * ALL RIGHTS RESERVED
+ * [This program is licensed under the "3-clause ('new') BSD License"]
+ * Please see the file COPYING in the source
+ * distribution of this software for license terms.
+ */
+
+/*
+ * The feature set simhash used before bottomk: a heap max
+ * int priority queue, and a simple hash table stop list
+ * ala corman-leiserson-rivest.  Kept only for
+ * bench/bkbench to compare against.
+ * Bart Massey 2005/03
+ */
+
+#include <assert.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include "oldheap.h"
+
+/* empty the heap, making room for size elements */
+void heap_reset(heap *h, int size) {
+    h->n = 0;
+    if (h->v && h->max == size)
+	return;
+    if (h->v)
+	free(h->v);
+    h->max = size;
+    h->v = malloc(size * sizeof(*h->v));
+    assert(h->v);
+}
+
+void heap_free(heap *h) {
+    free(h->v);
+    h->v = 0;
+    h->n = h->max = 0;
+}
+
+/* push the top of heap down as needed to
+   restore the heap property */
+static void downheap(heap *h) {
+    unsigned *heap = h->v;
+    int nheap = h->n;
+    unsigned tmp;
+    int i = 0;
+    while(1) {
+	int left =  (i << 1) + 1;
+	int right = left + 1;
+	if (left >= nheap)
+	    return;
+	if (right >= nheap) {
+	    if (heap[i] < heap[left]) {
+		tmp = heap[left];
+		heap[left] = heap[i];
+		heap[i] = tmp;
+	    }
+	    return;
+	}
+	if (heap[i] >= heap[left] &&
+	    heap[i] >= heap[right])
+	    return;
+	if (heap[left] > heap[right]) {
+	    tmp = heap[left];
+	    heap[left] = heap[i];
+	    heap[i] = tmp;
+	    i = left;
+	} else {
+	    tmp = heap[right];
+	    heap[right] = heap[i];
+	    heap[i] = tmp;
+	    i = right;
+	}
+    }
+}
+
+unsigned heap_extract_max(heap *h) {
+    unsigned m;
+    assert(h->n > 0);
+    /* lift the last heap element to the top,
+       replacing the current top element */
+    m = h->v[0];
+    h->v[0] = h->v[--h->n];
+    /* now restore the heap property */
+    downheap(h);
+    /* and return the former top */
+    return m;
+}
+
+/* lift the last value on the heap up
+   as needed to restore the heap property */
+static void upheap(heap *h) {
+    unsigned *heap = h->v;
+    int i = h->n - 1;
+    assert(h->n > 0);
+    while(i > 0) {
+	unsigned tmp;
+	int parent = (i - 1) >> 1;
+	if (heap[parent] >= heap[i])
+	    return;
+	tmp = heap[parent];
+	heap[parent] = heap[i];
+	heap[i] = tmp;
+	i = parent;
+    }
+}
+
+void heap_insert(heap *h, unsigned v) {
+    assert(h->n < h->max);
+    h->v[h->n++] = v;
+    upheap(h);
+}
+
+/* occupancy states */
+#define EMPTY 0
+#define FULL 1
+#define DELETED 2
+
+/* for n > 0 */
+static int next_pow2(int n) {
+    int m = 1;
+    while (n > 0) {
+	n >>= 1;
+	m <<= 1;
+    }
+    return m;
+}
+
+static void hash_alloc(hashtab *t) {
+    t->hash = malloc(t->nhash * sizeof(*t->hash));
+    assert(t->hash);
+    t->occ = malloc(t->nhash);
+    assert(t->occ);
+}
+
+static void hash_clear(hashtab *t) {
+    int i;
+    for (i = 0; i < t->nhash; i++)
+	t->occ[i] = EMPTY;
+}
+
+/* The occupancy shouldn't be bad, since we only keep small crcs in
+   the stop list */
+
+void hash_reset(hashtab *t, int size) {
+    int nhash = next_pow2(7 * size);
+    if (!t->hash || t->nhash != nhash) {
+	hash_free(t);
+	t->nhash = nhash;
+	hash_alloc(t);
+    }
+    hash_clear(t);
+}
+
+void hash_free(hashtab *t) {
+    free(t->hash);
+    free(t->occ);
+    t->hash = 0;
+    t->occ = 0;
+    t->nhash = 0;
+}
+
+/* Since the input values are crc's, we don't
+   try to hash them at all!  they're plenty random
+   coming in, in principle. */
+
+static int do_hash_insert(hashtab *t, unsigned crc) {
+    int count;
+    int nhash = t->nhash;
+    unsigned h = crc;
+    for (count = 0; count < nhash; count++) {
+	int i = h & (nhash - 1);
+	if (t->occ[i] != FULL) {
+	    t->occ[i] = FULL;
+	    t->hash[i] = crc;
+	    return 1;
+	}
+	if (t->hash[i] == crc)
+	    return 1;
+	h += 2 * (nhash / 4) + 1;
+    }
+    return 0;
+}
+
+/* idiot stop-and-copy for deleted references */
+static void gc(hashtab *t) {
+    int i;
+    unsigned *oldhash = t->hash;
+    char *oldocc = t->occ;
+    hash_alloc(t);
+    hash_clear(t);
+    for (i = 0; i < t->nhash; i++) {
+	if (oldocc[i] == FULL) {
+	    if(!do_hash_insert(t, oldhash[i])) {
+		fprintf(stderr, "internal error: gc failed, table full\n");
+		exit(1);
+	    }
+	}
+    }
+    free(oldhash);
+    free(oldocc);
+}
+
+void hash_insert(hashtab *t, unsigned crc) {
+    if (do_hash_insert(t, crc))
+	return;
+    gc(t);
+    if (do_hash_insert(t, crc))
+	return;
+    fprintf(stderr, "internal error: insert failed, table full\n");
+    abort();
+    /*NOTREACHED*/
+}
+
+static int do_hash_contains(hashtab *t, unsigned crc) {
+    int count;
+    int nhash = t->nhash;
+    unsigned h = crc;
+    for (count = 0; count < nhash; count++) {
+	int i = h & (nhash - 1);
+	if (t->occ[i] == EMPTY)
+	    return 0;
+	if (t->occ[i] == FULL && t->hash[i] == crc)
+	    return 1;
+	h += 2 * (nhash / 4) + 1;
+    }
+    return -1;
+}
+
+int hash_contains(hashtab *t, unsigned crc) {
+    int result = do_hash_contains(t, crc);
+    if (result >= 0)
+	return result;
+    gc(t);
+    result = do_hash_contains(t, crc);
+    if (result >= 0)
+	return result;
+    fprintf(stderr, "internal error: can't find value, table full\n");
+    abort();
+    /*NOTREACHED*/
+}
+
+static int do_hash_delete(hashtab *t, unsigned crc) {
+    int count;
+    int nhash = t->nhash;
+    unsigned h = crc;
+    for (count = 0; count < nhash; count++) {
+	int i = h & (nhash - 1);
+	if (t->occ[i] == FULL && t->hash[i] == crc) {
+	    t->occ[i] = DELETED;
+	    return 1;
+	}
+	if (t->occ[i] == EMPTY)
+	    return 0;
+	h += 2 * (nhash / 4) + 1;
+    }
+    return -1;
+}
+
+int hash_delete(hashtab *t, unsigned crc) {
+    int result = do_hash_delete(t, crc);
+    if (result >= 0)
+	return result;
+    gc(t);
+    result = do_hash_delete(t, crc);
+    if (result >= 0)
+	return result;
+    fprintf(stderr, "internal error: delete failed, table full\n");
+    abort();
+    /*NOTREACHED*/
+}
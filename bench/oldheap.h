@@ -0,0 +1,30 @@
+/*
+ * Copyright © 2005-2009 Bart Massey
+ * ALL RIGHTS RESERVED
+ * [This program is licensed under the "3-clause ('new') BSD License"]
+ * Please see the file COPYING in the source
+ * distribution of this software for license terms.
+ */
+
+typedef struct heap {
+    unsigned *v;
+    int n;
+    int max;
+} heap;
+
+extern void heap_reset(heap *, int);
+extern void heap_free(heap *);
+extern unsigned heap_extract_max(heap *);
+extern void heap_insert(heap *, unsigned);
+
+typedef struct hashtab {
+    unsigned *hash;
+    char *occ;  /* occupancy is out-of-band.  sigh */
+    int nhash;
+} hashtab;
+
+extern void hash_reset(hashtab *, int);
+extern void hash_free(hashtab *);
+extern int hash_contains(hashtab *, unsigned);
+extern void hash_insert(hashtab *, unsigned);
+extern int hash_delete(hashtab *, unsigned);
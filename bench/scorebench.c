@@ -0,0 +1,220 @@
+/*
+ * Copyright © 2005-2009 Bart Massey
+ * ALL RIGHTS RESERVED
+ * [This program is licensed under the "3-clause ('new') BSD License"]
+ * Please see the file COPYING in the source
+ * distribution of this software for license terms.
+ */
+
+/*
+ * Microbenchmark of shingleprint comparison.  First the
+ * intersection kernels, on a small pool of shingleprints
+ * that stays in cache: the old branching merge from
+ * score(), the branch-free scalar merge, and the SSE4.2
+ * and AVX2 block merges.  Every kernel must give the same
+ * counts as the old merge.  Then many-vs-many scoring
+ * against more shingleprints than fit in cache, a row at
+ * a time and a tile at a time.
+ */
+
+#define _GNU_SOURCE
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include "../sketch.h"
+#include "../simd.h"
+#include "../score.h"
+
+/* shingleprints in the kernel pool */
+#define NPOOL 64
+/* bytes of shingleprints in the many-vs-many test */
+#define BIG (32 * 1024 * 1024)
+/* rows scored against them */
+#define NROWS 32
+
+static unsigned seed = 2463534242U;
+
+static unsigned xorshift(void) {
+    seed ^= seed << 13;
+    seed ^= seed >> 17;
+    seed ^= seed << 5;
+    return seed;
+}
+
+static double now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static int cmp_unsigned(const void *a, const void *b) {
+    unsigned x = *(const unsigned *)a;
+    unsigned y = *(const unsigned *)b;
+    return (x > y) - (x < y);
+}
+
+/* the merge from score() before the kernels */
+static int intersect_old(const unsigned *a, int na,
+			 const unsigned *b, int nb) {
+    int i1 = 0, i2 = 0;
+    int matchcount = 0;
+    while (i1 < na && i2 < nb) {
+	if (a[i1] < b[i2]) {
+	    i1++;
+	    continue;
+	}
+	if (a[i1] > b[i2]) {
+	    i2++;
+	    continue;
+	}
+	matchcount++;
+	i1++;
+	i2++;
+    }
+    return matchcount;
+}
+
+/* Fill in n shingleprints of k features, in families of
+   eight variants of one random set, each with up to half
+   its features replaced: similar enough to match often,
+   different enough to make the merges work. */
+static hashinfo *make_hashes(int n, int k) {
+    hashinfo *his = malloc(n * sizeof his[0]);
+    unsigned *base = malloc(k * sizeof base[0]);
+    int i, j;
+    assert(his && base);
+    for (i = 0; i < n; i++) {
+	unsigned *f = malloc(k * sizeof f[0]);
+	int nchange = xorshift() % (k / 2 + 1);
+	assert(f);
+	if (i % 8 == 0)
+	    for (j = 0; j < k; j++)
+		base[j] = xorshift();
+	for (j = 0; j < k; j++)
+	    f[j] = base[j];
+	for (j = 0; j < nchange; j++)
+	    f[xorshift() % k] = xorshift();
+	/* duplicates are vanishingly rare; squeeze them out */
+	qsort(f, k, sizeof f[0], cmp_unsigned);
+	his[i].nfeature = 0;
+	for (j = 0; j < k; j++)
+	    if (j == 0 || f[j] != f[j - 1])
+		f[his[i].nfeature++] = f[j];
+	his[i].feature = f;
+	his[i].coded = 0;
+	his[i].nbits = 0;
+	his[i].family = HASH_DEFAULT;
+	his[i].nshingle = 8;
+    }
+    free(base);
+    return his;
+}
+
+static void free_hashes(hashinfo *his, int n) {
+    int i;
+    for (i = 0; i < n; i++)
+	free(his[i].feature);
+    free(his);
+}
+
+typedef int intersector(const unsigned *a, int na,
+			const unsigned *b, int nb);
+
+/* ns per intersection over all pairs of the pool,
+   checking each count against the old merge */
+static double time_kernel(hashinfo *pool, int *counts, intersector *f) {
+    int reps = 0;
+    double t0 = now();
+    double t;
+    do {
+	int i, j, n = 0;
+	for (i = 0; i < NPOOL; i++)
+	    for (j = 0; j < i; j++) {
+		int c = f(pool[i].feature, pool[i].nfeature,
+			  pool[j].feature, pool[j].nfeature);
+		assert(c == counts[n]);
+		n++;
+	    }
+	reps++;
+	t = now() - t0;
+    } while (t < 0.2);
+    return t * 1e9 / (reps * (NPOOL * (NPOOL - 1) / 2));
+}
+
+static void kernels(int k) {
+    hashinfo *pool = make_hashes(NPOOL, k);
+    int *counts = malloc(NPOOL * NPOOL * sizeof counts[0]);
+    double told, tscalar, tsse = 0, tavx = 0;
+    int i, j, n = 0;
+    assert(counts);
+    for (i = 0; i < NPOOL; i++)
+	for (j = 0; j < i; j++)
+	    counts[n++] = intersect_old(pool[i].feature, pool[i].nfeature,
+					pool[j].feature, pool[j].nfeature);
+    told = time_kernel(pool, counts, intersect_old);
+    tscalar = time_kernel(pool, counts, intersect_scalar);
+    simd_init(1);
+    if (simd_sse42) {
+	simd_avx2 = 0;
+	tsse = time_kernel(pool, counts, intersect_count);
+    }
+    simd_init(1);
+    if (simd_avx2)
+	tavx = time_kernel(pool, counts, intersect_count);
+    printf("%-6d %9.1f %9.1f %9.1f %9.1f %7.2fx\n", k, told, tscalar,
+	   tsse, tavx, told / (tavx > 0 ? tavx : tsse > 0 ? tsse : tscalar));
+    free(counts);
+    free_hashes(pool, NPOOL);
+}
+
+/* ns per score of NROWS rows against more columns than
+   fit in cache, by rows and then by tiles */
+static void tiles(int k) {
+    int ncol = BIG / (k * sizeof(unsigned));
+    hashinfo *rows = make_hashes(NROWS, k);
+    hashinfo *cols = make_hashes(ncol, k);
+    hashinfo **colp = malloc(ncol * sizeof colp[0]);
+    double *byrow = malloc(NROWS * ncol * sizeof byrow[0]);
+    double *bytile = malloc(NROWS * ncol * sizeof bytile[0]);
+    int tile = score_tile_size(k);
+    double t0, trow, ttile;
+    int i, j;
+    assert(colp && byrow && bytile);
+    for (j = 0; j < ncol; j++)
+	colp[j] = &cols[j];
+    t0 = now();
+    for (i = 0; i < NROWS; i++)
+	score_tile(&rows[i], colp, ncol, &byrow[i * ncol]);
+    trow = now() - t0;
+    t0 = now();
+    for (j = 0; j < ncol; j += tile) {
+	int n = ncol - j < tile ? ncol - j : tile;
+	for (i = 0; i < NROWS; i++)
+	    score_tile(&rows[i], colp + j, n, &bytile[i * ncol + j]);
+    }
+    ttile = now() - t0;
+    for (i = 0; i < NROWS * ncol; i++)
+	assert(byrow[i] == bytile[i]);
+    printf("%-6d %6d %5d %9.1f %9.1f %7.2fx\n", k, ncol, tile,
+	   trow * 1e9 / (NROWS * ncol), ttile * 1e9 / (NROWS * ncol),
+	   trow / ttile);
+    free(colp);
+    free(byrow);
+    free(bytile);
+    free_hashes(rows, NROWS);
+    free_hashes(cols, ncol);
+}
+
+int main(void) {
+    int k;
+    printf("%-6s %9s %9s %9s %9s %8s\n", "k",
+	   "old ns", "scalar ns", "sse4 ns", "avx2 ns", "speedup");
+    for (k = 128; k <= 8192; k *= 8)
+	kernels(k);
+    printf("\n%-6s %6s %5s %9s %9s %8s\n", "k",
+	   "cols", "tile", "row ns", "tile ns", "speedup");
+    for (k = 128; k <= 8192; k *= 8)
+	tiles(k);
+    return 0;
+}
@@ -0,0 +1,372 @@
+/*
+ * Copyright © 2005-2009 Bart Massey
+ * ALL RIGHTS RESERVED
+ * [This program is licensed under the "3-clause ('new') BSD License"]
+ * Please see the file COPYING in the source
+ * distribution of this software for license terms.
+ */
+
+/*
+ * Load generator for a sketch server (simhash --serve).
+ * The given files are hashed by the server and added to
+ * its corpus under their names.  Then each of nconn
+ * connections, each with its own thread, sends nreq
+ * requests of the given kind as fast as it gets answers,
+ * on randomly chosen files, and the latency of every
+ * request is recorded.
+ *
+ *   simload [-c nconn] [-n nreq] [-o op] [-t ntop] [-p] socket file ...
+ *
+ * op is hash, add, query, compare or mix, which cycles
+ * through the other four.  With -p, instead, the replies
+ * to hash, query or compare requests for each file in
+ * turn are printed, to check them: the hash the server
+ * makes of the file, its top ntop matches as "file score
+ * name" lines, or its score against each file before it.
+ */
+
+#define _GNU_SOURCE
+#include <assert.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <fcntl.h>
+#include "../frame.h"
+
+struct file {
+    char *name;
+    unsigned char *data;
+    size_t ndata;
+    unsigned char *hash;   /* as the server gave it */
+    size_t nhash;
+};
+
+static struct file *files;
+static int nfiles;
+static char *sockname;
+static int nreq = 1000;
+static int ntop = 10;
+static int op = 0;         /* 0 for mix */
+static int print = 0;
+
+/* a connection's state and results */
+struct client {
+    int fd;
+    unsigned seed;
+    unsigned char *req, *reply;
+    size_t nreq_alloc, nreply_alloc;
+    double *latency;
+};
+
+static double now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static unsigned xorshift(unsigned *seed) {
+    *seed ^= *seed << 13;
+    *seed ^= *seed >> 17;
+    *seed ^= *seed << 5;
+    return *seed;
+}
+
+static int connect_server(void) {
+    struct sockaddr_un addr;
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    memset(&addr, 0, sizeof addr);
+    addr.sun_family = AF_UNIX;
+    strncpy(addr.sun_path, sockname, sizeof addr.sun_path - 1);
+    if (fd == -1 ||
+	connect(fd, (struct sockaddr *) &addr, sizeof addr) == -1) {
+	perror(sockname);
+	exit(1);
+    }
+    return fd;
+}
+
+static unsigned char *req_space(struct client *c, size_t n) {
+    if (n > c->nreq_alloc) {
+	c->nreq_alloc = n;
+	c->req = realloc(c->req, n);
+	assert(c->req);
+    }
+    return c->req;
+}
+
+/* Send a request and wait for the reply, which must be
+   a good one.  Returns the reply's length. */
+static size_t request(struct client *c, int rop,
+		      const unsigned char *buf, size_t n) {
+    int type;
+    size_t nreply;
+    if (frame_write(c->fd, rop, buf, n) == -1 ||
+	frame_read(c->fd, &type, &c->reply, &nreply, &c->nreply_alloc) != 1) {
+	perror(sockname);
+	exit(1);
+    }
+    if (type != FRAME_OK) {
+	fprintf(stderr, "simload: request '%c' failed: %.*s\n",
+		rop, (int) nreply, c->reply);
+	exit(1);
+    }
+    return nreply;
+}
+
+/* name NUL, then the n bytes of p, in the request buffer */
+static size_t named(struct client *c, char *name,
+		    const unsigned char *p, size_t n) {
+    size_t len = strlen(name) + 1;
+    unsigned char *q = req_space(c, len + n);
+    memcpy(q, name, len);
+    memcpy(q + len, p, n);
+    return len + n;
+}
+
+static void one_request(struct client *c, int rop) {
+    struct file *f = &files[xorshift(&c->seed) % nfiles];
+    struct file *g;
+    unsigned char *q;
+    size_t n;
+    switch (rop) {
+    case OP_HASH:
+	request(c, OP_HASH, f->data, f->ndata);
+	break;
+    case OP_ADD:
+	n = named(c, f->name, f->hash, f->nhash);
+	request(c, OP_ADD, c->req, n);
+	break;
+    case OP_QUERY:
+	q = req_space(c, 4 + f->nhash);
+	q[0] = ntop >> 24;
+	q[1] = ntop >> 16;
+	q[2] = ntop >> 8;
+	q[3] = ntop;
+	memcpy(q + 4, f->hash, f->nhash);
+	request(c, OP_QUERY, q, 4 + f->nhash);
+	break;
+    case OP_COMPARE:
+	g = &files[xorshift(&c->seed) % nfiles];
+	n = named(c, f->name, (unsigned char *) g->name, strlen(g->name) + 1);
+	request(c, OP_COMPARE, c->req, n);
+	break;
+    default:
+	abort();
+    }
+}
+
+static void *run_client(void *arg) {
+    static int mix[] = {OP_HASH, OP_ADD, OP_QUERY, OP_COMPARE};
+    struct client *c = arg;
+    int i;
+    for (i = 0; i < nreq; i++) {
+	double t0 = now();
+	one_request(c, op ? op : mix[i % 4]);
+	c->latency[i] = now() - t0;
+    }
+    /* the server may be waiting for a connection to
+       finish before it takes the next */
+    close(c->fd);
+    return 0;
+}
+
+static void read_file(struct file *f) {
+    struct stat st;
+    size_t got = 0;
+    int fd = open(f->name, O_RDONLY);
+    if (fd == -1 || fstat(fd, &st) == -1) {
+	perror(f->name);
+	exit(1);
+    }
+    f->ndata = st.st_size;
+    f->data = malloc(f->ndata + 1);
+    assert(f->data);
+    while (got < f->ndata) {
+	ssize_t r = read(fd, f->data + got, f->ndata - got);
+	if (r <= 0) {
+	    perror(f->name);
+	    exit(1);
+	}
+	got += r;
+    }
+    close(fd);
+}
+
+/* have the server hash each file, and keep the hash
+   under the file's name */
+static void load_files(void) {
+    struct client c;
+    int i;
+    memset(&c, 0, sizeof c);
+    c.fd = connect_server();
+    for (i = 0; i < nfiles; i++) {
+	struct file *f = &files[i];
+	size_t n;
+	read_file(f);
+	f->nhash = request(&c, OP_HASH, f->data, f->ndata);
+	f->hash = malloc(f->nhash);
+	assert(f->hash);
+	memcpy(f->hash, c.reply, f->nhash);
+	n = named(&c, f->name, f->hash, f->nhash);
+	request(&c, OP_ADD, c.req, n);
+    }
+    close(c.fd);
+    free(c.req);
+    free(c.reply);
+}
+
+static void usage(void) {
+    fprintf(stderr, "simload: usage: simload [-c nconn] [-n nreq] "
+	    "[-o hash|add|query|compare|mix] [-t ntop] [-p] "
+	    "socket file ...\n");
+    exit(1);
+}
+
+/* a request for each file, in order, with its reply on
+   standard output */
+static void print_replies(void) {
+    struct client c;
+    unsigned char *q;
+    size_t n, i;
+    int j, k;
+    memset(&c, 0, sizeof c);
+    c.fd = connect_server();
+    for (j = 0; j < nfiles; j++) {
+	struct file *f = &files[j];
+	switch (op) {
+	case OP_HASH:
+	    n = request(&c, OP_HASH, f->data, f->ndata);
+	    fwrite(c.reply, 1, n, stdout);
+	    break;
+	case OP_QUERY:
+	    q = req_space(&c, 4 + f->nhash);
+	    q[0] = ntop >> 24;
+	    q[1] = ntop >> 16;
+	    q[2] = ntop >> 8;
+	    q[3] = ntop;
+	    memcpy(q + 4, f->hash, f->nhash);
+	    n = request(&c, OP_QUERY, q, 4 + f->nhash);
+	    for (i = 0; i < n; i++) {
+		if (i == 0 || c.reply[i - 1] == '\n')
+		    printf("%s ", f->name);
+		putchar(c.reply[i]);
+	    }
+	    break;
+	case OP_COMPARE:
+	    for (k = 0; k < j; k++) {
+		struct file *g = &files[k];
+		n = named(&c, f->name, (unsigned char *) g->name,
+			  strlen(g->name) + 1);
+		n = request(&c, OP_COMPARE, c.req, n);
+		fwrite(c.reply, 1, n, stdout);
+	    }
+	    break;
+	default:
+	    usage();
+	}
+    }
+    close(c.fd);
+    free(c.req);
+    free(c.reply);
+}
+
+static int cmp_double(const void *a, const void *b) {
+    double x = *(const double *)a;
+    double y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+
+int main(int argc, char **argv) {
+    static struct {
+	char *name;
+	int op;
+    } ops[] = {
+	{"hash", OP_HASH}, {"add", OP_ADD}, {"query", OP_QUERY},
+	{"compare", OP_COMPARE}, {"mix", 0}, {0, 0}
+    };
+    char *opname = "mix";
+    int nconn = 1;
+    struct client *clients;
+    pthread_t *tids;
+    double *all;
+    double t0, elapsed;
+    int i, j, c;
+    while ((c = getopt(argc, argv, "c:n:o:pt:")) != -1) {
+	switch (c) {
+	case 'c':
+	    nconn = atoi(optarg);
+	    break;
+	case 'n':
+	    nreq = atoi(optarg);
+	    break;
+	case 'o':
+	    for (i = 0; ops[i].name; i++)
+		if (!strcmp(ops[i].name, optarg))
+		    break;
+	    if (!ops[i].name)
+		usage();
+	    opname = ops[i].name;
+	    op = ops[i].op;
+	    break;
+	case 'p':
+	    print = 1;
+	    break;
+	case 't':
+	    ntop = atoi(optarg);
+	    break;
+	default:
+	    usage();
+	}
+    }
+    if (nconn < 1 || nreq < 1 || ntop < 1 || argc - optind < 2)
+	usage();
+    sockname = argv[optind++];
+    nfiles = argc - optind;
+    files = calloc(nfiles, sizeof files[0]);
+    assert(files);
+    for (i = 0; i < nfiles; i++)
+	files[i].name = argv[optind + i];
+    load_files();
+    if (print) {
+	print_replies();
+	return 0;
+    }
+    clients = calloc(nconn, sizeof clients[0]);
+    tids = malloc(nconn * sizeof tids[0]);
+    all = malloc((size_t) nconn * nreq * sizeof all[0]);
+    assert(clients && tids && all);
+    for (i = 0; i < nconn; i++) {
+	clients[i].fd = connect_server();
+	clients[i].seed = 2463534242U + i;
+	clients[i].latency = all + (size_t) i * nreq;
+    }
+    t0 = now();
+    for (i = 0; i < nconn; i++)
+	if (pthread_create(&tids[i], 0, run_client, &clients[i]) != 0) {
+	    fprintf(stderr, "simload: can't start client thread\n");
+	    exit(1);
+	}
+    for (i = 0; i < nconn; i++)
+	pthread_join(tids[i], 0);
+    elapsed = now() - t0;
+    for (i = 0; i < nconn; i++) {
+	free(clients[i].req);
+	free(clients[i].reply);
+    }
+    j = nconn * nreq;
+    qsort(all, j, sizeof all[0], cmp_double);
+    printf("%-8s %5s %5s %8s %9s %9s %9s %10s\n", "op", "files", "conns",
+	   "requests", "p50 us", "p99 us", "max us", "req/s");
+    printf("%-8s %5d %5d %8d %9.1f %9.1f %9.1f %10.0f\n", opname, nfiles,
+	   nconn, j, all[j / 2] * 1e6, all[(int) (j * 0.99)] * 1e6,
+	   all[j - 1] * 1e6, j / elapsed);
+    return 0;
+}
@@ -0,0 +1,187 @@
+/*
+ * Copyright © 2005-2009 Bart Massey
+ * ALL RIGHTS RESERVED
+ * [This program is licensed under the "3-clause ('new') BSD License"]
+ * Please see the file COPYING in the source
+ * distribution of this software for license terms.
+ */
+
+/*
+ * Bottom-k set: the heap and stop list simhash used to
+ * keep, now in bench/oldheap.c, rolled into one
+ * structure.  Replacing the largest value is one pass
+ * down the heap rather than an extract and an insert.
+ * The stop list is a linear-probing table at most a
+ * quarter full, with no occupancy array: an empty slot
+ * holds EMPTY, and the rare value EMPTY is remembered
+ * separately.  Deletions shift later entries of the
+ * probe run back, so there are no tombstones and the
+ * table never needs collecting.  Full-size tables are
+ * allocated once and reused from one input to the next.
+ */
+
+#include <assert.h>
+#include <stdlib.h>
+#include "bottomk.h"
+
+#define EMPTY 0xffffffffU
+
+/* for n > 0 */
+static int next_pow2(int n) {
+    int m = 1;
+    while (m < n)
+	m <<= 1;
+    return m;
+}
+
+/* empty the set, making room for k values */
+void bottomk_reset(bottomk *b, int k) {
+    int i;
+    int nset = next_pow2(4 * k);
+    if (b->heap == 0 || b->k != k) {
+	bottomk_free(b);
+	b->heap = malloc(k * sizeof b->heap[0]);
+	assert(b->heap);
+	b->set = malloc(nset * sizeof b->set[0]);
+	assert(b->set);
+	b->k = k;
+	b->nset = nset;
+    }
+    for (i = 0; i < b->nset; i++)
+	b->set[i] = EMPTY;
+    b->n = 0;
+    b->has_empty = 0;
+}
+
+void bottomk_free(bottomk *b) {
+    free(b->heap);
+    free(b->set);
+    b->heap = 0;
+    b->set = 0;
+    b->n = b->k = b->nset = 0;
+}
+
+/* The values are already good hashes, so they index
+   the table directly.  They are also the smallest seen,
+   so their high bits are mostly zero: use the low ones. */
+#define SLOT(b, v) ((v) & ((b)->nset - 1))
+
+int bottomk_contains(bottomk *b, unsigned v) {
+    unsigned i;
+    if (v == EMPTY)
+	return b->has_empty;
+    for (i = SLOT(b, v); b->set[i] != EMPTY; i = SLOT(b, i + 1))
+	if (b->set[i] == v)
+	    return 1;
+    return 0;
+}
+
+static void set_insert(bottomk *b, unsigned v) {
+    unsigned i;
+    if (v == EMPTY) {
+	b->has_empty = 1;
+	return;
+    }
+    for (i = SLOT(b, v); b->set[i] != EMPTY; i = SLOT(b, i + 1))
+	continue;
+    b->set[i] = v;
+}
+
+/* remove v, which must be present, then close up the
+   gap by moving back any later entry of the probe run
+   that would no longer be found */
+static void set_delete(bottomk *b, unsigned v) {
+    unsigned i, j;
+    if (v == EMPTY) {
+	b->has_empty = 0;
+	return;
+    }
+    for (i = SLOT(b, v); b->set[i] != v; i = SLOT(b, i + 1))
+	assert(b->set[i] != EMPTY);
+    for (j = SLOT(b, i + 1); b->set[j] != EMPTY; j = SLOT(b, j + 1)) {
+	unsigned home = SLOT(b, b->set[j]);
+	/* can j's entry move to i without passing its home? */
+	if (SLOT(b, j - home) >= SLOT(b, j - i)) {
+	    b->set[i] = b->set[j];
+	    i = j;
+	}
+    }
+    b->set[i] = EMPTY;
+}
+
+/* lift the value at i up as needed to
+   restore the heap property */
+static void upheap(bottomk *b, int i) {
+    unsigned *heap = b->heap;
+    unsigned v = heap[i];
+    while (i > 0) {
+	int parent = (i - 1) >> 1;
+	if (heap[parent] >= v)
+	    break;
+	heap[i] = heap[parent];
+	i = parent;
+    }
+    heap[i] = v;
+}
+
+/* put v at the root and push it down as needed
+   to restore the heap property.  Which child is
+   larger is a coin flip, so pick it arithmetically
+   rather than with a branch. */
+static void replace_root(bottomk *b, unsigned v) {
+    unsigned *heap = b->heap;
+    int n = b->n;
+    int i = 0;
+    while (1) {
+	int c = 2 * i + 1;
+	if (c + 1 < n)
+	    c += heap[c + 1] > heap[c];
+	else if (c >= n)
+	    break;
+	if (heap[c] <= v)
+	    break;
+	heap[i] = heap[c];
+	i = c;
+    }
+    heap[i] = v;
+}
+
+/* add v, which must be new, to a set that isn't full */
+void bottomk_push(bottomk *b, unsigned v) {
+    assert(b->n < b->k);
+    b->heap[b->n] = v;
+    upheap(b, b->n++);
+    set_insert(b, v);
+}
+
+/* replace the largest value with v, which must be new
+   and smaller, in one pass down the heap; returns the
+   value replaced */
+unsigned bottomk_replace_max(bottomk *b, unsigned v) {
+    unsigned m = b->heap[0];
+    assert(b->n > 0 && v < m);
+    set_delete(b, m);
+    replace_root(b, v);
+    set_insert(b, v);
+    return m;
+}
+
+/* remove and return the largest value */
+unsigned bottomk_extract_max(bottomk *b) {
+    unsigned m = b->heap[0];
+    assert(b->n > 0);
+    set_delete(b, m);
+    if (--b->n > 0)
+	replace_root(b, b->heap[b->n]);
+    return m;
+}
+
+/* keep v if it is among the k smallest distinct values */
+void bottomk_insert(bottomk *b, unsigned v) {
+    if (!BOTTOMK_WANTED(b, v) || bottomk_contains(b, v))
+	return;
+    if (b->n < b->k)
+	bottomk_push(b, v);
+    else
+	bottomk_replace_max(b, v);
+}
@@ -0,0 +1,28 @@
+/*
+ * Copyright © 2005-2009 Bart Massey
+ * ALL RIGHTS RESERVED
+ * [This program is licensed under the "3-clause ('new') BSD License"]
+ * Please see the file COPYING in the source
+ * distribution of this software for license terms.
+ */
+
+/* the k smallest distinct values seen */
+typedef struct bottomk {
+    unsigned *heap;     /* max-heap of the values */
+    int n;
+    int k;
+    unsigned *set;      /* the same values, for finding duplicates */
+    int nset;
+    int has_empty;      /* is the empty-slot marker itself a value? */
+} bottomk;
+
+/* would v be kept if it were inserted? */
+#define BOTTOMK_WANTED(b, v) ((b)->n < (b)->k || (v) < (b)->heap[0])
+
+extern void bottomk_reset(bottomk *b, int k);
+extern void bottomk_free(bottomk *b);
+extern int bottomk_contains(bottomk *b, unsigned v);
+extern void bottomk_push(bottomk *b, unsigned v);
+extern unsigned bottomk_replace_max(bottomk *b, unsigned v);
+extern unsigned bottomk_extract_max(bottomk *b);
+extern void bottomk_insert(bottomk *b, unsigned v);
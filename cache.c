@@ -0,0 +1,494 @@
+/*
+ * Copyright © 2005-2009 Bart Massey
+ * ALL RIGHTS RESERVED
+ * [This program is licensed under the "3-clause ('new') BSD License"]
+ * Please see the file COPYING in the source
+ * distribution of this software for license terms.
+ */
+
+/*
+ * Rehash cache: the shingleprints of files already
+ * hashed, keyed on the file's identity (device, inode,
+ * size and modification time) and the shingleprint
+ * parameters, so that a file that hasn't changed need
+ * not be read again.  The cache file is
+ *
+ *   a 16-byte header
+ *   records, each a 52-byte cache_record followed
+ *   by its features, smallest first
+ *
+ * in the byte order of the machine that wrote it; file
+ * identities mean nothing on another machine anyway.
+ * The file is mapped and indexed when opened, and
+ * appended to, a run's new records at a time under a
+ * write lock, so runs may share it.  A later record for
+ * the same key wins.  A record cut short by a crash is
+ * cut off by the next run to append.  Once most of the
+ * records have been superseded, the run appending copies
+ * the rest to a new file and renames it over the old.
+ */
+
+#define _GNU_SOURCE
+#include <assert.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#include "sketch.h"
+#include "cache.h"
+
+#define CACHE_MAGIC "simcach"
+#define CACHE_ORDER 0x01020304U
+#define CACHE_VERSION 1
+#define RECORD_MAGIC 0x5eed5eedU
+
+struct cache_header {
+    char magic[8];
+    unsigned order;      /* CACHE_ORDER, in the writer's order */
+    unsigned version;
+};
+
+struct cache_record {
+    unsigned magic;      /* RECORD_MAGIC */
+    cache_key key;
+    unsigned nfeature;   /* features following */
+};
+
+struct cache {
+    char *filename;
+    int fd;
+    void *map;
+    size_t size;         /* of the map */
+    size_t end;          /* of the last whole record seen */
+    struct cache_record **slot;
+    int nslot;           /* a power of two */
+    int n;
+    struct cache_record **added;  /* to be appended */
+    int nadded, nalloc;
+    pthread_rwlock_t lock;   /* on slot and added */
+    pthread_mutex_t stats_lock;
+    cache_stats stats;
+};
+
+static size_t record_size(struct cache_record *r) {
+    return sizeof *r + (size_t) r->nfeature * sizeof(unsigned);
+}
+
+static unsigned *record_features(struct cache_record *r) {
+    return (unsigned *) (r + 1);
+}
+
+/* FNV-1a over the key */
+static unsigned key_hash(cache_key *key) {
+    unsigned char *p = (unsigned char *) key;
+    unsigned h = 2166136261U;
+    int i;
+    for (i = 0; i < sizeof *key; i++)
+	h = (h ^ p[i]) * 16777619U;
+    return h;
+}
+
+/* the slot with key, or the empty slot it would go in */
+static int find_slot(cache *c, cache_key *key) {
+    int s = key_hash(key) & (c->nslot - 1);
+    while (c->slot[s] && memcmp(&c->slot[s]->key, key, sizeof *key))
+	s = (s + 1) & (c->nslot - 1);
+    return s;
+}
+
+static void index_record(cache *c, struct cache_record *r) {
+    int s = find_slot(c, &r->key);
+    if (!c->slot[s]) {
+	c->n++;
+	if (2 * c->n > c->nslot) {
+	    struct cache_record **old = c->slot;
+	    int nold = c->nslot;
+	    int i;
+	    c->nslot *= 2;
+	    c->slot = calloc(c->nslot, sizeof c->slot[0]);
+	    assert(c->slot);
+	    for (i = 0; i < nold; i++)
+		if (old[i])
+		    c->slot[find_slot(c, &old[i]->key)] = old[i];
+	    free(old);
+	    s = find_slot(c, &r->key);
+	}
+    }
+    c->slot[s] = r;
+}
+
+/* The size of the whole records in the n bytes at p, a
+   run of records; *bad is set if one is not a record. */
+static size_t whole_records(char *p, size_t n, int *bad) {
+    size_t pos = 0;
+    *bad = 0;
+    while (n - pos >= sizeof(struct cache_record)) {
+	struct cache_record *r = (struct cache_record *) (p + pos);
+	if (r->magic != RECORD_MAGIC ||
+	    r->nfeature > (n - pos) / sizeof(unsigned)) {
+	    *bad = r->magic != RECORD_MAGIC;
+	    break;
+	}
+	if (record_size(r) > n - pos)
+	    break;
+	pos += record_size(r);
+    }
+    return pos;
+}
+
+static int lock_file(int fd, int type) {
+    struct flock fl;
+    memset(&fl, 0, sizeof fl);
+    fl.l_type = type;
+    fl.l_whence = SEEK_SET;
+    while (fcntl(fd, F_SETLKW, &fl) == -1)
+	if (errno != EINTR)
+	    return -1;
+    return 0;
+}
+
+/* Take the write lock on the cache file, opening it
+   again if another run has compacted it since: appends
+   to the old file would be lost. */
+static int lock_cache(cache *c) {
+    struct stat st, now;
+    while (1) {
+	if (lock_file(c->fd, F_WRLCK) == -1 || fstat(c->fd, &st) == -1 ||
+	    stat(c->filename, &now) == -1)
+	    return -1;
+	if (st.st_dev == now.st_dev && st.st_ino == now.st_ino)
+	    return 0;
+	close(c->fd);
+	c->fd = open(c->filename, O_RDWR | O_APPEND);
+	if (c->fd == -1)
+	    return -1;
+	/* none of this file has been looked at */
+	c->end = sizeof(struct cache_header);
+    }
+}
+
+static cache *bad_cache(cache *c, char *msg) {
+    if (msg)
+	fprintf(stderr, "%s: %s\n", c->filename, msg);
+    else
+	perror(c->filename);
+    if (c->map)
+	munmap(c->map, c->size);
+    if (c->fd != -1)
+	close(c->fd);
+    free(c->slot);
+    free(c);
+    return 0;
+}
+
+/* Open the cache in filename, making it if need be, and
+   index its records.  Returns a null pointer after
+   complaining on failure. */
+cache *cache_open(char *filename) {
+    struct cache_header h;
+    struct stat st;
+    cache *c = malloc(sizeof *c);
+    size_t pos;
+    int bad;
+    assert(c);
+    memset(c, 0, sizeof *c);
+    c->filename = filename;
+    c->nslot = 1024;
+    c->slot = calloc(c->nslot, sizeof c->slot[0]);
+    assert(c->slot);
+    pthread_rwlock_init(&c->lock, 0);
+    pthread_mutex_init(&c->stats_lock, 0);
+    c->fd = open(filename, O_RDWR | O_CREAT | O_APPEND, 0666);
+    if (c->fd == -1)
+	return bad_cache(c, 0);
+    /* the first run writes the header */
+    if (lock_file(c->fd, F_WRLCK) == -1 || fstat(c->fd, &st) == -1)
+	return bad_cache(c, 0);
+    if (st.st_size == 0) {
+	memset(&h, 0, sizeof h);
+	memcpy(h.magic, CACHE_MAGIC, sizeof CACHE_MAGIC);
+	h.order = CACHE_ORDER;
+	h.version = CACHE_VERSION;
+	if (write(c->fd, &h, sizeof h) != sizeof h)
+	    return bad_cache(c, 0);
+	st.st_size = sizeof h;
+    }
+    lock_file(c->fd, F_UNLCK);
+    if (st.st_size < sizeof h)
+	return bad_cache(c, "bad rehash cache");
+    c->size = st.st_size;
+    c->map = mmap(0, c->size, PROT_READ, MAP_PRIVATE, c->fd, 0);
+    if (c->map == MAP_FAILED) {
+	c->map = 0;
+	return bad_cache(c, 0);
+    }
+    memcpy(&h, c->map, sizeof h);
+    if (memcmp(h.magic, CACHE_MAGIC, sizeof CACHE_MAGIC) != 0 ||
+	h.order != CACHE_ORDER || h.version != CACHE_VERSION)
+	return bad_cache(c, "bad rehash cache");
+    /* index what is there now; appends by others since
+       are ignored */
+    c->end = sizeof h +
+	whole_records((char *) c->map + sizeof h, c->size - sizeof h, &bad);
+    if (bad)
+	fprintf(stderr, "%s: warning: bad rehash cache record\n", filename);
+    for (pos = sizeof h; pos < c->end; ) {
+	struct cache_record *r = (struct cache_record *) ((char *) c->map + pos);
+	index_record(c, r);
+	c->stats.records++;
+	pos += record_size(r);
+    }
+    return c;
+}
+
+static void split64(unsigned *w, unsigned long v) {
+    w[0] = (v >> 16) >> 16;
+    w[1] = v;
+}
+
+/* Fill in key for the open file fd and the shingleprint
+   parameters.  Returns 0 if fd isn't a regular file,
+   whose identity says nothing about its contents. */
+int cache_make_key(int fd, int nshingle, int nfeature, int family,
+		   cache_key *key) {
+    struct stat st;
+    if (fstat(fd, &st) == -1 || !S_ISREG(st.st_mode))
+	return 0;
+    memset(key, 0, sizeof *key);
+    split64(&key->id[0], st.st_dev);
+    split64(&key->id[2], st.st_ino);
+    split64(&key->id[4], st.st_size);
+    split64(&key->id[6], st.st_mtim.tv_sec);
+    key->id[8] = st.st_mtim.tv_nsec;
+    key->family = family;
+    key->nshingle = nshingle;
+    key->nfeature = nfeature;
+    return 1;
+}
+
+/* Copy the hash cached for key into hi, whose features
+   must have room for as many as the key asks for, or its
+   signature's words.  Returns 0 if there is none.  May
+   be called from many threads at once, which look up
+   side by side under the read lock. */
+int cache_find(cache *c, cache_key *key, hashinfo *hi) {
+    struct cache_record *r;
+    unsigned room = key->family & FILE_BITSIG ?
+	key->nfeature / 32 : key->nfeature;
+    pthread_rwlock_rdlock(&c->lock);
+    r = c->slot[find_slot(c, key)];
+    if (r && r->nfeature <= room) {
+	hi->family = r->key.family & FILE_KIND;
+	hi->nshingle = r->key.nshingle;
+	hi->nfeature = r->nfeature;
+	hi->nbits = r->key.family & FILE_BITSIG ? 32 * r->nfeature : 0;
+	memcpy(hi->feature, record_features(r),
+	       r->nfeature * sizeof(unsigned));
+	hi->coded = 0;
+    } else {
+	r = 0;
+    }
+    pthread_rwlock_unlock(&c->lock);
+    pthread_mutex_lock(&c->stats_lock);
+    if (r)
+	c->stats.hits++;
+    else
+	c->stats.misses++;
+    pthread_mutex_unlock(&c->stats_lock);
+    return r != 0;
+}
+
+/* Remember hi as the hash for key, to be appended to the
+   file when the cache is closed.  May be called from many
+   threads at once. */
+void cache_add(cache *c, cache_key *key, hashinfo *hi) {
+    struct cache_record *r =
+	malloc(sizeof *r + (size_t) hi->nfeature * sizeof(unsigned));
+    assert(r);
+    r->magic = RECORD_MAGIC;
+    r->key = *key;
+    r->nfeature = hi->nfeature;
+    memcpy(record_features(r), hi->feature, hi->nfeature * sizeof(unsigned));
+    pthread_rwlock_wrlock(&c->lock);
+    if (c->nadded == c->nalloc) {
+	c->nalloc = c->nalloc ? 2 * c->nalloc : 64;
+	c->added = realloc(c->added, c->nalloc * sizeof c->added[0]);
+	assert(c->added);
+    }
+    c->added[c->nadded++] = r;
+    index_record(c, r);
+    pthread_rwlock_unlock(&c->lock);
+    pthread_mutex_lock(&c->stats_lock);
+    c->stats.added++;
+    pthread_mutex_unlock(&c->stats_lock);
+}
+
+void cache_get_stats(cache *c, cache_stats *stats) {
+    pthread_mutex_lock(&c->stats_lock);
+    *stats = c->stats;
+    pthread_mutex_unlock(&c->stats_lock);
+}
+
+/* Cut off a record left short at the end of the file by
+   a run that died while appending, or anything else that
+   isn't a record: nothing after it could be read.  The
+   caller holds the write lock. */
+static int trim_tail(cache *c) {
+    struct stat st;
+    size_t n;
+    char *buf;
+    size_t whole;
+    int bad;
+    if (fstat(c->fd, &st) == -1)
+	return -1;
+    if (st.st_size <= c->end)
+	return 0;
+    n = st.st_size - c->end;
+    buf = malloc(n);
+    assert(buf);
+    if (pread(c->fd, buf, n, c->end) != n) {
+	free(buf);
+	return -1;
+    }
+    whole = whole_records(buf, n, &bad);
+    free(buf);
+    if (whole < n)
+	return ftruncate(c->fd, c->end + whole);
+    return 0;
+}
+
+/* Write the n bytes at buf to a new file beside the
+   cache, with the cache's permissions, and rename it over
+   the cache. */
+static int replace_file(cache *c, char *buf, size_t n) {
+    struct stat st;
+    char *tmpname = malloc(strlen(c->filename) + 8);
+    int fd;
+    int result = -1;
+    assert(tmpname);
+    sprintf(tmpname, "%s.XXXXXX", c->filename);
+    if (fstat(c->fd, &st) == -1 || (fd = mkstemp(tmpname)) == -1) {
+	free(tmpname);
+	return -1;
+    }
+    if (fchmod(fd, st.st_mode & 0777) == 0 && write(fd, buf, n) == n &&
+	close(fd) == 0) {
+	fd = -1;
+	result = rename(tmpname, c->filename);
+    }
+    if (fd != -1)
+	close(fd);
+    if (result == -1)
+	unlink(tmpname);
+    free(tmpname);
+    return result;
+}
+
+/* Rewrite the file without the records later ones have
+   superseded, once they are more than half of it.  A
+   record is superseded by a later one for the same file
+   and parameters, whatever its size and modification
+   time: the file has changed since.  The caller holds
+   the write lock. */
+static int compact(cache *c) {
+    struct stat st;
+    cache live;
+    struct cache_record *file;  /* each record's, by file */
+    char *buf, *out;
+    size_t pos, end, n;
+    int nrecord = 0;
+    int bad, i;
+    int result = 0;
+    if (fstat(c->fd, &st) == -1)
+	return -1;
+    buf = malloc(st.st_size);
+    assert(buf);
+    if (pread(c->fd, buf, st.st_size, 0) != st.st_size) {
+	free(buf);
+	return -1;
+    }
+    /* index the whole file afresh: other runs may have
+       appended since this one opened it */
+    memset(&live, 0, sizeof live);
+    live.nslot = 1024;
+    live.slot = calloc(live.nslot, sizeof live.slot[0]);
+    assert(live.slot);
+    end = sizeof(struct cache_header) +
+	whole_records(buf + sizeof(struct cache_header),
+		      st.st_size - sizeof(struct cache_header), &bad);
+    file = malloc((end / sizeof *file + 1) * sizeof *file);
+    assert(file);
+    for (pos = sizeof(struct cache_header); pos < end; ) {
+	struct cache_record *r = (struct cache_record *) (buf + pos);
+	file[nrecord] = *r;
+	/* size and modification times */
+	for (i = 4; i < 9; i++)
+	    file[nrecord].key.id[i] = 0;
+	index_record(&live, &file[nrecord]);
+	nrecord++;
+	pos += record_size(r);
+    }
+    if (nrecord - live.n > live.n) {
+	out = malloc(end);
+	assert(out);
+	n = sizeof(struct cache_header);
+	memcpy(out, buf, n);
+	i = 0;
+	for (pos = n; pos < end; i++) {
+	    struct cache_record *r = (struct cache_record *) (buf + pos);
+	    if (live.slot[find_slot(&live, &file[i].key)] == &file[i]) {
+		memcpy(out + n, r, record_size(r));
+		n += record_size(r);
+	    }
+	    pos += record_size(r);
+	}
+	result = replace_file(c, out, n);
+	free(out);
+    }
+    free(file);
+    free(live.slot);
+    free(buf);
+    return result;
+}
+
+/* Append the new records to the file, compacting it if
+   need be, and free the cache.  Returns -1 with errno set
+   if the append failed. */
+int cache_close(cache *c) {
+    int result = 0;
+    int i;
+    if (c->nadded > 0) {
+	size_t n = 0;
+	char *buf;
+	for (i = 0; i < c->nadded; i++)
+	    n += record_size(c->added[i]);
+	buf = malloc(n);
+	assert(buf);
+	n = 0;
+	for (i = 0; i < c->nadded; i++) {
+	    memcpy(buf + n, c->added[i], record_size(c->added[i]));
+	    n += record_size(c->added[i]);
+	}
+	if (lock_cache(c) == -1 || trim_tail(c) == -1 ||
+	    write(c->fd, buf, n) != n || compact(c) == -1)
+	    result = -1;
+	lock_file(c->fd, F_UNLCK);
+	free(buf);
+    }
+    for (i = 0; i < c->nadded; i++)
+	free(c->added[i]);
+    free(c->added);
+    munmap(c->map, c->size);
+    close(c->fd);
+    free(c->slot);
+    pthread_rwlock_destroy(&c->lock);
+    pthread_mutex_destroy(&c->stats_lock);
+    free(c);
+    return result;
+}
@@ -0,0 +1,41 @@
+/*
+ * Copyright © 2005-2009 Bart Massey
+ * ALL RIGHTS RESERVED
+ * [This program is licensed under the "3-clause ('new') BSD License"]
+ * Please see the file COPYING in the source
+ * distribution of this software for license terms.
+ */
+
+/* what a cached hash is the hash of: a file's identity,
+   and the shingleprint parameters */
+typedef struct cache_key {
+    unsigned id[9];     /* device, inode, size and mtime seconds,
+			   high and low words; mtime nanoseconds */
+    unsigned short family;  /* with FILE_TOKENS for words,
+			       FILE_BITSIG for a signature,
+			       and the DECOMP_ format the file
+			       was read through, shifted */
+    unsigned short nshingle;
+    unsigned nfeature;  /* as asked for, or bits of signature */
+} cache_key;
+
+/* where the DECOMP_ format goes in the key's family */
+#define CACHE_FORMAT_SHIFT 8
+
+typedef struct cache cache;
+
+/* counts since the cache was opened */
+typedef struct cache_stats {
+    int records;        /* read from the file */
+    int hits;
+    int misses;
+    int added;
+} cache_stats;
+
+extern cache *cache_open(char *filename);
+extern int cache_make_key(int fd, int nshingle, int nfeature, int family,
+			  cache_key *key);
+extern int cache_find(cache *c, cache_key *key, hashinfo *hi);
+extern void cache_add(cache *c, cache_key *key, hashinfo *hi);
+extern void cache_get_stats(cache *c, cache_stats *stats);
+extern int cache_close(cache *c);
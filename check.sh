@@ -0,0 +1,343 @@
+#!/bin/sh
+# Copyright (c) 2005-2007 Bart Massey
+# ALL RIGHTS RESERVED
+# Please see the file COPYING in this directory for license information.
+
+# check that the different ways of computing a hash
+# all give bit-for-bit the same answer
+
+SIMHASH=${SIMHASH:-./simhash}
+TMP=`mktemp -d` || exit 1
+trap 'rm -rf $TMP' 0
+FAIL=0
+
+# random, and highly repetitive, inputs of awkward sizes
+for n in 1 7 100 32775 65536 300007 3000000; do
+  head -c $n /dev/urandom > $TMP/r$n
+  yes "the quick brown fox $n" | head -c $n > $TMP/t$n
+done
+
+same() {
+  if ! cmp -s $TMP/a $TMP/b
+  then
+    echo "FAIL: $*"
+    FAIL=1
+  fi
+}
+
+for f in $TMP/r* $TMP/t*; do
+  for opts in "-s 4 -f 1" "-s 8" "-s 8 -f 1000" "-s 61 -f 64" \
+              "-H crc32c -s 4 -f 1" "-H crc32c -f 1000" "-H crc32c -s 61"; do
+    $SIMHASH --no-simd $opts $f > $TMP/a 2>/dev/null
+    $SIMHASH $opts $f > $TMP/b 2>/dev/null
+    same "vector kernel: $opts $f"
+    $SIMHASH $opts < $f > $TMP/b 2>/dev/null
+    same "stdin: $opts $f"
+  done
+done
+
+# delta-coded hashes must score just as plain ones do,
+# whether scored a tile at a time or a pair at a time
+for opts in "-s 8" "-s 4 -f 2000" "-H crc32c -f 1000"; do
+  $SIMHASH $opts -m $TMP/r* $TMP/t* > $TMP/a 2>/dev/null
+  $SIMHASH $opts --compress -m $TMP/r* $TMP/t* > $TMP/b 2>/dev/null
+  same "coded matrix: $opts"
+  $SIMHASH $opts -m --threshold 0 $TMP/r* $TMP/t* > $TMP/a 2>/dev/null
+  $SIMHASH $opts --compress -w --pack $TMP/pack $TMP/r* $TMP/t* 2>/dev/null
+  $SIMHASH -m --threshold 0 --pack $TMP/pack > $TMP/b 2>/dev/null
+  same "coded pack: $opts"
+done
+
+# a shingleprint whose only feature is 0 codes in a
+# width byte alone, and decodes to itself
+head -c 8 /dev/zero > $TMP/z8
+$SIMHASH -f 1 $TMP/z8 > $TMP/plain.sim 2>/dev/null
+$SIMHASH -f 1 --compress $TMP/z8 > $TMP/coded.sim 2>/dev/null
+echo 9 > $TMP/a
+wc -c < $TMP/coded.sim | tr -d ' ' > $TMP/b
+same "zero feature code size"
+echo 1.0 > $TMP/a
+$SIMHASH -c $TMP/plain.sim $TMP/coded.sim > $TMP/b 2>/dev/null
+same "zero feature round trip"
+
+# shingleprints of a file split across threads are those
+# of the file hashed whole, in every family
+for f in $TMP/r300007 $TMP/t300007 $TMP/r3000000; do
+  for opts in "-H rabin" "-H crc32" "-H crc32c" "-s 4 -f 1000"; do
+    $SIMHASH $opts $f > $TMP/a 2>/dev/null
+    $SIMHASH $opts -j 3 --split-size 100000 $f > $TMP/b 2>/dev/null
+    same "split shingleprint: $opts $f"
+  done
+done
+
+# signatures come out the same however the file is read,
+# hashed in pieces or a byte at a time
+for f in $TMP/r300007 $TMP/t300007 $TMP/r3000000; do
+  for opts in "--mode bitsig" "--mode bitsig --bits 128 -H crc32c" \
+              "--mode bitsig -H crc32"; do
+    $SIMHASH $opts $f > $TMP/a 2>/dev/null
+    $SIMHASH $opts -j 3 --split-size 100000 $f > $TMP/b 2>/dev/null
+    same "split signature: $opts $f"
+    $SIMHASH $opts < $f > $TMP/b 2>/dev/null
+    same "stdin signature: $opts $f"
+    $SIMHASH $opts -d $f 2>/dev/null > $TMP/b
+    same "traced signature: $opts $f"
+  done
+done
+
+# shingles of words come out the same however the file is
+# read, and whatever its case and spacing
+for f in $TMP/t300007 $TMP/t3000000 $TMP/r300007; do
+  for opts in "--tokens 1" "--tokens 4 -f 1000" "--tokens 3 -H crc32c" \
+              "--tokens 5 --mode bitsig"; do
+    $SIMHASH $opts $f > $TMP/a 2>/dev/null
+    cat $f | $SIMHASH $opts > $TMP/b 2>/dev/null
+    same "piped words: $opts $f"
+    $SIMHASH $opts -j 3 --split-size 100000 $f > $TMP/b 2>/dev/null
+    same "split words: $opts $f"
+    $SIMHASH $opts -d $f 2>/dev/null > $TMP/b
+    same "traced words: $opts $f"
+    case $f in
+    */t*)
+      tr 'a-z ' 'A-Z\n' < $f | $SIMHASH $opts > $TMP/b 2>/dev/null
+      same "case and spacing: $opts $f"
+      ;;
+    esac
+  done
+done
+
+# a compressed file hashes as what it decompresses to,
+# mapped or piped, in one stream or several; formats this
+# build can't read are hashed as they are, and skipped
+for z in gzip xz; do
+  command -v $z > /dev/null || continue
+  for f in $TMP/r300007 $TMP/t3000000; do
+    $z -c $f > $TMP/z
+    $z -c $TMP/t32775 >> $TMP/z
+    cat $f $TMP/t32775 > $TMP/c
+    $SIMHASH --no-decompress $TMP/z > $TMP/a 2>/dev/null
+    $SIMHASH $TMP/z > $TMP/b 2>/dev/null
+    cmp -s $TMP/a $TMP/b && continue
+    $SIMHASH $TMP/c > $TMP/a 2>/dev/null
+    same "$z mapped: $f"
+    cat $TMP/z | $SIMHASH > $TMP/b 2>/dev/null
+    same "$z piped: $f"
+    { cat $TMP/z; echo "trailing garbage"; } > $TMP/g
+    $SIMHASH $TMP/g > $TMP/b 2>/dev/null
+    same "$z trailing garbage: $f"
+    # one damaged file is not hashed, and the rest are
+    n=`wc -c < $TMP/z`
+    head -c `expr $n / 2` $TMP/z > $TMP/cut
+    echo "1.0 ?" > $TMP/a
+    $SIMHASH -m $TMP/c $TMP/cut $TMP/z 2>/dev/null |
+      awk 'NR == 4 { print $3, $4 }' > $TMP/b
+    same "$z cut short: $f"
+  done
+done
+
+# the signature tables find every pair that comparing
+# them all does, near-copies and all
+mkdir $TMP/near
+for i in 1 2 3 4 5 6 7 8; do
+  for f in r300007 t32775; do
+    n=`wc -c < $TMP/$f`
+    k=`expr $n / 9 \* $i`
+    { head -c $k $TMP/$f; echo "edit $i"; tail -c +$k $TMP/$f; } > $TMP/near/$f.$i
+  done
+done
+for bits in 64 128; do
+  for t in 0.98 0.95 0.9 0.8 0; do
+    $SIMHASH --mode bitsig --bits $bits -m --threshold $t \
+      $TMP/near/* $TMP/r* $TMP/t* 2>/dev/null | sort > $TMP/a
+    $SIMHASH --mode bitsig --bits $bits -m --top 100 \
+      $TMP/near/* $TMP/r* $TMP/t* 2>/dev/null |
+      awk -v t=$t '{ s = $1 == "1.0" ? 1 : $1; if (s + 0 >= t && $2 < $3) print }' |
+      sort > $TMP/b
+    same "signature tables: $bits bits, threshold $t"
+  done
+done
+
+# hashing files on several threads writes and compares
+# just what hashing them one at a time does
+mkdir $TMP/j1 $TMP/j4
+cp $TMP/near/* $TMP/r* $TMP/t* $TMP/j1
+cp $TMP/near/* $TMP/r* $TMP/t* $TMP/j4
+$SIMHASH -w -j 1 $TMP/j1/* 2>/dev/null
+$SIMHASH -w -j 4 $TMP/j4/* 2>/dev/null
+ls $TMP/j1 > $TMP/a
+ls $TMP/j4 > $TMP/b
+same "threaded .sim files"
+for f in `ls $TMP/j1 | grep '\.sim$'`; do
+  cp $TMP/j1/$f $TMP/a
+  cp $TMP/j4/$f $TMP/b
+  same "threaded .sim: $f"
+done
+$SIMHASH -m -j 1 $TMP/near/* $TMP/r* $TMP/t* > $TMP/a 2>/dev/null
+$SIMHASH -m -j 4 $TMP/near/* $TMP/r* $TMP/t* > $TMP/b 2>/dev/null
+same "threaded matrix"
+
+# a walked tree, or a list of names, hashes as the same
+# files named in order on the command line
+$SIMHASH -m -j 3 $TMP/near/* > $TMP/a 2>/dev/null
+$SIMHASH -m -j 3 -r $TMP/near > $TMP/b 2>/dev/null
+same "walked tree"
+case $SIMHASH in /*) S=$SIMHASH ;; *) S=`pwd`/$SIMHASH ;; esac
+(cd $TMP && $S -m near/* > a 2>/dev/null &&
+  printf 'near/%s\0' `ls near` | $S -m --files-from - > b 2>/dev/null)
+same "list of names"
+
+# the index finds the same best matches, with the same
+# scores, as comparing the query with everything, however
+# many appends it was built in; it only finds files that
+# share a feature with the query
+mkdir $TMP/win
+for i in 1 2 3 4 5 6 7 8; do
+  head -c `expr $i \* 40000 + 200000` $TMP/r3000000 | tail -c 200000 > $TMP/win/$i
+done
+Q=$TMP/win/1
+REST="`ls $TMP/win/* | grep -v "^$Q\$"` `ls $TMP/near/*`"
+FIRST=`echo $REST | tr ' ' '\n' | head -10`
+LAST=`echo $REST | tr ' ' '\n' | tail -n +11`
+for opts in "-s 8" "-H crc32c -f 300 --compress" "--tokens 2"; do
+  rm -f $TMP/index
+  $SIMHASH $opts -m --top 10 $Q $REST 2>/dev/null |
+    awk -v q=$Q '$2 == q && $1 != ".00"' > $TMP/a
+  $SIMHASH $opts --index $TMP/index $FIRST 2>/dev/null
+  $SIMHASH $opts -j 2 --index $TMP/index $LAST 2>/dev/null
+  $SIMHASH $opts --index $TMP/index --query $Q --top 10 2>/dev/null |
+    awk '$1 != ".00"' > $TMP/b
+  same "index query: $opts"
+done
+
+# the groups are those the pairs above the threshold join,
+# with signatures and shingleprints, coded or not
+ALL=`ls $TMP/near/* $TMP/win/* $TMP/r* $TMP/t*`
+for opts in "-s 8" "-s 4 -f 300 --compress" "--mode bitsig" \
+            "--mode bitsig --bits 128"; do
+  for t in 0.9 0.5 0.2; do
+    { echo "$ALL"; echo; $SIMHASH $opts -m --threshold $t $ALL 2>/dev/null; } |
+      awk 'function root(i) { while (up[i] != i) i = up[i]; return i }
+        !pairs && $0 == "" { pairs = 1; next }
+        !pairs { n++; name[n] = $0; num[$0] = n; up[n] = n; next }
+        { a = root(num[$2]); b = root(num[$3])
+          if (a < b) up[b] = a; else up[a] = b }
+        END {
+          for (i = 1; i <= n; i++) { r = root(i); size[r]++
+            group[r] = group[r] (size[r] > 1 ? " " : "") name[i] }
+          for (i = 1; i <= n; i++)
+            if (root(i) == i && size[i] > 1) print group[i]
+        }' > $TMP/a
+    $SIMHASH $opts --cluster $t $ALL > $TMP/b 2>/dev/null
+    same "clusters: $opts, threshold $t"
+  done
+done
+
+# the rehash cache gives what rereading does, cold, warm
+# and after files change, even in place to the same size;
+# records for changed files are compacted away
+mkdir $TMP/cached
+cp $TMP/near/* $TMP/cached
+for run in cold warm grown X Y; do
+  case $run in
+  grown)
+    echo "grown" >> $TMP/cached/t32775.3 ;;
+  X|Y)
+    for f in $TMP/cached/*; do
+      { head -c 100 $f; printf $run; tail -c +102 $f; } > $TMP/c
+      cat $TMP/c > $f
+    done ;;
+  esac
+  $SIMHASH -m $TMP/cached/* > $TMP/a 2>/dev/null
+  $SIMHASH --cache $TMP/cache -m $TMP/cached/* > $TMP/b 2>/dev/null
+  same "rehash cache: $run"
+done
+n=`ls $TMP/cached | wc -l`
+m=`$SIMHASH --cache $TMP/cache --cache-stats -m $TMP/cached/* 2>&1 >/dev/null |
+  sed -n 's/.* \([0-9]*\) records read/\1/p'`
+if [ -z "$m" ] || [ $m -gt `expr 2 \* $n` ]
+then
+  echo "FAIL: rehash cache of $n files holds ${m} records"
+  FAIL=1
+fi
+
+# a sketch server hashes, compares and finds the nearest
+# just as the command line does
+SIMLOAD=${SIMLOAD:-bench/simload}
+[ -x $SIMLOAD ] || make -s $SIMLOAD
+WIN=`ls $TMP/win/*`
+$SIMHASH --serve $TMP/sock $WIN 2>/dev/null &
+SERVER=$!
+trap 'kill $SERVER 2>/dev/null; rm -rf $TMP' 0
+n=0
+while [ ! -S $TMP/sock ] && [ $n -lt 50 ]; do
+  sleep 0.1
+  n=`expr $n + 1`
+done
+for f in $WIN; do
+  $SIMHASH $f
+done > $TMP/a 2>/dev/null
+$SIMLOAD -p -o hash $TMP/sock $WIN > $TMP/b 2>/dev/null
+same "server hash"
+$SIMHASH -m $WIN 2>/dev/null |
+  awk 'NR > 2 { for (i = 3; i <= NF; i++) print $i }' > $TMP/a
+$SIMLOAD -p -o compare $TMP/sock $WIN 2>/dev/null |
+  awk '{ print $1 }' > $TMP/b
+same "server compare"
+$SIMHASH -m --top 3 $WIN > $TMP/a 2>/dev/null
+$SIMLOAD -p -o query -t 4 $TMP/sock $WIN 2>/dev/null |
+  awk '$1 != $3 { print $2, $1, $3 }' > $TMP/b
+same "server query"
+if ! $SIMLOAD -c 20 -n 20 $TMP/sock $WIN > /dev/null 2>&1
+then
+  echo "FAIL: more clients than the server answers at once"
+  FAIL=1
+fi
+# a socket being served can't be taken, but a dead
+# server's can
+if $SIMHASH --serve $TMP/sock $WIN 2>/dev/null
+then
+  echo "FAIL: second server on a live socket"
+  FAIL=1
+fi
+kill $SERVER
+wait $SERVER 2>/dev/null
+$SIMHASH --serve $TMP/sock $WIN 2>/dev/null &
+SERVER=$!
+n=0
+until $SIMLOAD -p -o hash $TMP/sock $WIN > $TMP/b 2>/dev/null ||
+  [ $n -ge 50 ]; do
+  sleep 0.1
+  n=`expr $n + 1`
+done
+for f in $WIN; do
+  $SIMHASH $f
+done > $TMP/a 2>/dev/null
+same "server on a dead server's socket"
+kill $SERVER
+
+# hashing one small file after another allocates nothing
+# more, so however many there are, the memory used stays
+# the same; set CHECK_NFILES to 1000000 for the long run
+mkdir $TMP/small
+for i in 0 1 2 3 4 5 6 7 8 9; do
+  head -c `expr $i \* 300 + 50` $TMP/r32775 > $TMP/small/$i
+done
+(cd $TMP/small && printf '%s\0' *) > $TMP/names
+NFILES=${CHECK_NFILES:-20000}
+rss() {
+  n=0
+  while [ $n -lt $1 ]; do
+    cat $TMP/names
+    n=`expr $n + 10`
+  done > $TMP/list
+  (cd $TMP/small && $S -w -j 3 --stats --files-from $TMP/list 2>&1 |
+    sed -n 's/.*"max_rss_kb": \([0-9]*\).*/\1/p')
+}
+FEW=`rss 100`
+MANY=`rss $NFILES`
+if [ -z "$FEW" ] || [ -z "$MANY" ] || [ $MANY -gt `expr $FEW + 1024` ]
+then
+  echo "FAIL: memory grew from ${FEW}kB to ${MANY}kB over $NFILES files"
+  FAIL=1
+fi
+exit $FAIL
@@ -0,0 +1,53 @@
+/*
+ * Copyright © 2005-2009 Bart Massey
+ * ALL RIGHTS RESERVED
+ * [This program is licensed under the "3-clause ('new') BSD License"]
+ * Please see the file COPYING in the source
+ * distribution of this software for license terms.
+ */
+
+/*
+ * Rolling CRC32C (Castagnoli) of a fixed-size window.
+ * With a zero initial value and no final inversion a
+ * CRC is linear in its input, so the contribution of
+ * the byte leaving the window can be looked up and
+ * removed, and sliding the window costs the same at any
+ * window size.  The CRC step is the one computed by the
+ * SSE4.2 crc32 instruction, which simd.c uses when it
+ * can.
+ */
+
+#include "crc32c.h"
+
+/* the reflected Castagnoli polynomial */
+#define POLY 0x82f63b78U
+
+void crc32c_init(crc32c *c, int nwindow) {
+    int t, i;
+    for (t = 0; t < 256; t++) {
+	unsigned v = t;
+	for (i = 0; i < 8; i++) {
+	    if (v & 1)
+		v = (v >> 1) ^ POLY;
+	    else
+		v >>= 1;
+	}
+	c->tab[t] = v;
+    }
+    /* the CRC of t followed by nwindow zero bytes */
+    for (t = 0; t < 256; t++) {
+	unsigned crc = CRC32C_APPEND(c, 0U, (unsigned)t);
+	for (i = 0; i < nwindow; i++)
+	    crc = CRC32C_APPEND(c, crc, 0U);
+	c->out[t] = crc;
+    }
+}
+
+/* the CRC of the n bytes at p */
+unsigned crc32c_fingerprint(crc32c *c, const unsigned char *p, int n) {
+    unsigned crc = 0;
+    int i;
+    for (i = 0; i < n; i++)
+	crc = CRC32C_APPEND(c, crc, p[i]);
+    return crc;
+}
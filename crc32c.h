@@ -0,0 +1,25 @@
+/*
+ * Copyright © 2005-2009 Bart Massey
+ * ALL RIGHTS RESERVED
+ * [This program is licensed under the "3-clause ('new') BSD License"]
+ * Please see the file COPYING in the source
+ * distribution of this software for license terms.
+ */
+
+/* tables for a rolling CRC32C of a fixed-size window */
+typedef struct crc32c {
+    unsigned tab[256];    /* the usual byte-at-a-time table */
+    unsigned out[256];    /* contribution of the byte leaving the window */
+} crc32c;
+
+/* append byte ch to crc; the same as the SSE4.2
+   crc32 instruction */
+#define CRC32C_APPEND(c, crc, ch) \
+    ((c)->tab[((crc) ^ (ch)) & 0xff] ^ ((crc) >> 8))
+
+/* append byte chin and drop byte chout, keeping the window size fixed */
+#define CRC32C_ROLL(c, crc, chin, chout) \
+    (CRC32C_APPEND(c, crc, chin) ^ (c)->out[chout])
+
+extern void crc32c_init(crc32c *c, int nwindow);
+extern unsigned crc32c_fingerprint(crc32c *c, const unsigned char *p, int n);
@@ -0,0 +1,359 @@
+/*
+ * Copyright © 2005-2009 Bart Massey
+ * ALL RIGHTS RESERVED
+ * [This program is licensed under the "3-clause ('new') BSD License"]
+ * Please see the file COPYING in the source
+ * distribution of this software for license terms.
+ */
+
+/*
+ * Compressed input.  A file is recognized by its first
+ * bytes, and decompressed by a thread of its own while
+ * the calling thread shingles what it has already made:
+ * the two take turns with a pair of buffers, one being
+ * filled while the other is shingled.  The bytes
+ * shingled are exactly the decompressed file, in the
+ * same order, so the shingleprint is that of the
+ * decompressed file.  Concatenated streams, as made by
+ * appending compressed files, are decompressed one after
+ * another, as zcat and xzcat do.  Once a stream has been
+ * decompressed, anything after it that doesn't decompress
+ * to at least a byte is trailing garbage, and ignored, as
+ * gzip does.  A stream that is damaged, or cut short,
+ * fails with EBADMSG.
+ */
+
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <assert.h>
+#ifdef HAVE_ZLIB
+#include <zlib.h>
+#endif
+#ifdef HAVE_LZMA
+#include <lzma.h>
+#endif
+#include "sketch.h"
+#include "decomp.h"
+
+/* size of each of the buffers handed over */
+#define OUTBUF (1024 * 1024)
+/* read size for compressed input */
+#define INBUF (256 * 1024)
+
+/* the compressed format of a file starting with the n
+   bytes at p */
+int decomp_format(const unsigned char *p, size_t n) {
+#ifdef HAVE_ZLIB
+    if (n >= 3 && p[0] == 0x1f && p[1] == 0x8b && p[2] == 8)
+	return DECOMP_GZIP;
+#endif
+#ifdef HAVE_LZMA
+    if (n >= 6 && !memcmp(p, "\3757zXZ\0", 6))
+	return DECOMP_XZ;
+#endif
+    return DECOMP_NONE;
+}
+
+struct decomp {
+    int format;
+    /* the compressed input: head, then fd if it isn't -1 */
+    const unsigned char *head;
+    size_t nhead;
+    int fd;
+    unsigned char *in;
+    /* the handoff */
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    unsigned char *buf[2];
+    size_t len[2];
+    int full[2];            /* waiting to be shingled? */
+    int done;               /* nothing more will be full */
+    int error;              /* if nonzero, why not */
+    /* the decompressor's progress */
+    int nstream;            /* streams finished */
+    int between;            /* after one, before the next? */
+    int ended;              /* at trailing garbage? */
+    unsigned long mark;     /* output before this stream */
+#ifdef HAVE_ZLIB
+    z_stream z;
+#endif
+#ifdef HAVE_LZMA
+    lzma_stream x;
+#endif
+};
+
+#if defined(HAVE_ZLIB) || defined(HAVE_LZMA)
+/* Point *p at the next *n bytes of compressed input.
+   Returns 0 at the end of it, -1 with errno set on a
+   read error. */
+static int more_input(struct decomp *d, const unsigned char **p,
+		      size_t *n) {
+    ssize_t got;
+    if (d->nhead > 0) {
+	*p = d->head;
+	*n = d->nhead;
+	d->nhead = 0;
+	return 1;
+    }
+    if (d->fd == -1)
+	return 0;
+    do
+	got = read(d->fd, d->in, INBUF);
+    while (got == -1 && errno == EINTR);
+    if (got == -1)
+	return -1;
+    if (got == 0)
+	return 0;
+    *p = d->in;
+    *n = got;
+    return 1;
+}
+#endif
+
+/* Each filler decompresses into the n bytes at out,
+   setting *made to the bytes made, which are fewer than
+   n only at the end.  Returns 0 if all is well, or an
+   errno value: EBADMSG if the input is damaged. */
+
+/* Has a stream that has gone wrong made nothing, after
+   another that was whole?  Then it is trailing garbage,
+   and the end of the input. */
+static int garbage(struct decomp *d, unsigned long out) {
+    if (d->nstream == 0 || out != d->mark)
+	return 0;
+    d->ended = 1;
+    return 1;
+}
+
+#ifdef HAVE_ZLIB
+static int gzip_fill(struct decomp *d, unsigned char *out, size_t n,
+		     size_t *made) {
+    z_stream *z = &d->z;
+    z->next_out = out;
+    z->avail_out = n;
+    /* inflateReset() starts the counts again for each
+       stream */
+    d->mark = 0;
+    while (z->avail_out > 0 && !d->ended) {
+	int r;
+	if (z->avail_in == 0) {
+	    const unsigned char *p;
+	    size_t np;
+	    r = more_input(d, &p, &np);
+	    if (r == -1)
+		return errno;
+	    if (r == 0) {
+		/* cut off in the middle of a stream? */
+		if (z->total_in > 0 && !garbage(d, z->total_out))
+		    return EBADMSG;
+		break;
+	    }
+	    z->next_in = (unsigned char *) p;
+	    z->avail_in = np;
+	}
+	r = inflate(z, Z_NO_FLUSH);
+	if (r == Z_STREAM_END) {
+	    /* maybe another stream follows */
+	    d->nstream++;
+	    if (inflateReset(z) != Z_OK)
+		return EBADMSG;
+	    continue;
+	}
+	if (r != Z_OK && r != Z_BUF_ERROR && !garbage(d, z->total_out))
+	    return r == Z_MEM_ERROR ? ENOMEM : EBADMSG;
+    }
+    *made = n - z->avail_out;
+    return 0;
+}
+#endif
+
+#ifdef HAVE_LZMA
+static int xz_fill(struct decomp *d, unsigned char *out, size_t n,
+		   size_t *made) {
+    lzma_stream *x = &d->x;
+    lzma_action action = LZMA_RUN;
+    x->next_out = out;
+    x->avail_out = n;
+    while (x->avail_out > 0 && !d->ended) {
+	lzma_ret r;
+	if (x->avail_in == 0 && action == LZMA_RUN) {
+	    const unsigned char *p;
+	    size_t np;
+	    int m = more_input(d, &p, &np);
+	    if (m == -1)
+		return errno;
+	    if (m == 0) {
+		action = LZMA_FINISH;
+	    } else {
+		x->next_in = p;
+		x->avail_in = np;
+	    }
+	}
+	if (d->between) {
+	    /* stream padding is zero bytes */
+	    while (x->avail_in > 0 && *x->next_in == 0) {
+		x->next_in++;
+		x->avail_in--;
+	    }
+	    if (x->avail_in == 0) {
+		if (action == LZMA_FINISH)
+		    break;
+		continue;
+	    }
+	    if (lzma_stream_decoder(x, UINT64_MAX, 0) != LZMA_OK)
+		return ENOMEM;
+	    d->between = 0;
+	    d->mark = x->total_out;
+	}
+	r = lzma_code(x, action);
+	if (r == LZMA_STREAM_END) {
+	    /* maybe another stream follows */
+	    d->nstream++;
+	    d->between = 1;
+	    continue;
+	}
+	if (r != LZMA_OK && !garbage(d, x->total_out))
+	    return r == LZMA_MEM_ERROR ? ENOMEM : EBADMSG;
+    }
+    *made = n - x->avail_out;
+    return 0;
+}
+#endif
+
+static int fill(struct decomp *d, unsigned char *out, size_t n,
+		size_t *made) {
+    switch (d->format) {
+#ifdef HAVE_ZLIB
+    case DECOMP_GZIP:
+	return gzip_fill(d, out, n, made);
+#endif
+#ifdef HAVE_LZMA
+    case DECOMP_XZ:
+	return xz_fill(d, out, n, made);
+#endif
+    }
+    abort();
+    /*NOTREACHED*/
+}
+
+/* the decompression thread: fill each buffer in turn
+   once it has been shingled */
+static void *decompress(void *arg) {
+    struct decomp *d = arg;
+    int i = 0;
+    while (1) {
+	size_t made = 0;
+	int error;
+	pthread_mutex_lock(&d->lock);
+	while (d->full[i])
+	    pthread_cond_wait(&d->cond, &d->lock);
+	pthread_mutex_unlock(&d->lock);
+	error = fill(d, d->buf[i], OUTBUF, &made);
+	pthread_mutex_lock(&d->lock);
+	d->len[i] = made;
+	d->full[i] = made > 0;
+	d->error = error;
+	d->done = error || made < OUTBUF;
+	pthread_cond_signal(&d->cond);
+	pthread_mutex_unlock(&d->lock);
+	if (error || made < OUTBUF)
+	    return 0;
+	i ^= 1;
+    }
+}
+
+/* Feed ctx the decompression of the compressed input,
+   the nhead bytes at head followed by whatever can be
+   read from fd, or nothing more if fd is -1.  Returns 0,
+   or -1 with errno set if the input couldn't be read, or
+   to EBADMSG if it isn't what it seemed. */
+int decomp_feed(simhash_ctx *ctx, int format,
+		const unsigned char *head, size_t nhead, int fd) {
+    struct decomp d;
+    pthread_t thread;
+    int i = 0;
+    int error = 0;
+    memset(&d, 0, sizeof d);
+    d.format = format;
+    d.head = head;
+    d.nhead = nhead;
+    d.fd = fd;
+    switch (format) {
+#ifdef HAVE_ZLIB
+    case DECOMP_GZIP:
+	/* gzip headers only */
+	if (inflateInit2(&d.z, 16 + MAX_WBITS) != Z_OK) {
+	    errno = ENOMEM;
+	    return -1;
+	}
+	break;
+#endif
+#ifdef HAVE_LZMA
+    case DECOMP_XZ:
+	/* one stream at a time, so that what follows can be
+	   looked at */
+	if (lzma_stream_decoder(&d.x, UINT64_MAX, 0) != LZMA_OK) {
+	    errno = ENOMEM;
+	    return -1;
+	}
+	break;
+#endif
+    default:
+	abort();
+    }
+    d.in = malloc(INBUF);
+    d.buf[0] = malloc(OUTBUF);
+    d.buf[1] = malloc(OUTBUF);
+    assert(d.in && d.buf[0] && d.buf[1]);
+    pthread_mutex_init(&d.lock, 0);
+    pthread_cond_init(&d.cond, 0);
+    if (pthread_create(&thread, 0, decompress, &d) != 0) {
+	perror("pthread_create");
+	exit(1);
+    }
+    while (1) {
+	pthread_mutex_lock(&d.lock);
+	while (!d.full[i] && !d.done)
+	    pthread_cond_wait(&d.cond, &d.lock);
+	if (!d.full[i]) {
+	    error = d.error;
+	    pthread_mutex_unlock(&d.lock);
+	    break;
+	}
+	pthread_mutex_unlock(&d.lock);
+	simhash_update(ctx, d.buf[i], d.len[i]);
+	pthread_mutex_lock(&d.lock);
+	d.full[i] = 0;
+	pthread_cond_signal(&d.cond);
+	pthread_mutex_unlock(&d.lock);
+	i ^= 1;
+    }
+    pthread_join(thread, 0);
+    pthread_cond_destroy(&d.cond);
+    pthread_mutex_destroy(&d.lock);
+    free(d.in);
+    free(d.buf[0]);
+    free(d.buf[1]);
+    switch (format) {
+#ifdef HAVE_ZLIB
+    case DECOMP_GZIP:
+	inflateEnd(&d.z);
+	break;
+#endif
+#ifdef HAVE_LZMA
+    case DECOMP_XZ:
+	lzma_end(&d.x);
+	break;
+#endif
+    }
+    if (error) {
+	errno = error;
+	return -1;
+    }
+    return 0;
+}
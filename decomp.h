@@ -0,0 +1,20 @@
+/*
+ * Copyright © 2005-2009 Bart Massey
+ * ALL RIGHTS RESERVED
+ * [This program is licensed under the "3-clause ('new') BSD License"]
+ * Please see the file COPYING in the source
+ * distribution of this software for license terms.
+ */
+
+/* compressed formats; only those whose libraries were
+   found at build time are ever recognized */
+#define DECOMP_NONE 0
+#define DECOMP_GZIP 1
+#define DECOMP_XZ 2
+
+/* bytes needed to recognize any format */
+#define DECOMP_MAGIC 6
+
+extern int decomp_format(const unsigned char *p, size_t n);
+extern int decomp_feed(simhash_ctx *ctx, int format,
+		       const unsigned char *head, size_t nhead, int fd);
@@ -0,0 +1,121 @@
+/*
+ * Copyright © 2005-2009 Bart Massey
+ * ALL RIGHTS RESERVED
+ * [This program is licensed under the "3-clause ('new') BSD License"]
+ * Please see the file COPYING in the source
+ * distribution of this software for license terms.
+ */
+
+/*
+ * Framing for the sketch server protocol.  A frame is
+ * a 4-byte big-endian payload length, a type byte (the
+ * request op or reply status), then the payload.
+ */
+
+#define _XOPEN_SOURCE 600
+#include <assert.h>
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "frame.h"
+
+/* frames this small go out in one write */
+#define SMALL 4096
+
+#define HEADER 5
+
+static int write_all(int fd, const unsigned char *p, size_t n) {
+    while (n > 0) {
+	ssize_t w = write(fd, p, n);
+	if (w == -1) {
+	    if (errno == EINTR)
+		continue;
+	    return -1;
+	}
+	p += w;
+	n -= w;
+    }
+    return 0;
+}
+
+/* Returns the number of bytes read, short only at end
+   of file, or -1 on error. */
+static ssize_t read_all(int fd, unsigned char *p, size_t n) {
+    size_t got = 0;
+    while (got < n) {
+	ssize_t r = read(fd, p + got, n - got);
+	if (r == -1) {
+	    if (errno == EINTR)
+		continue;
+	    return -1;
+	}
+	if (r == 0)
+	    break;
+	got += r;
+    }
+    return got;
+}
+
+/* Send a frame of type with the n bytes of buf as its
+   payload.  Returns -1 with errno set on failure. */
+int frame_write(int fd, int type, const void *buf, size_t n) {
+    unsigned char small[SMALL];
+    unsigned char *h = small;
+    assert(n <= FRAME_MAX);
+    h[0] = n >> 24;
+    h[1] = n >> 16;
+    h[2] = n >> 8;
+    h[3] = n;
+    h[4] = type;
+    if (HEADER + n <= SMALL) {
+	memcpy(small + HEADER, buf, n);
+	return write_all(fd, small, HEADER + n);
+    }
+    if (write_all(fd, h, HEADER) == -1)
+	return -1;
+    return write_all(fd, buf, n);
+}
+
+/* Receive a frame into *buf, which holds *nalloc bytes
+   and is grown as needed, leaving its type and payload
+   length in *type and *n.  Returns 1 for a frame, 0 at
+   end of file between frames, and -1 with errno set on
+   failure. */
+int frame_read(int fd, int *type,
+	       unsigned char **buf, size_t *n, size_t *nalloc) {
+    unsigned char h[HEADER];
+    ssize_t r = read_all(fd, h, HEADER);
+    if (r == 0)
+	return 0;
+    if (r == -1)
+	return -1;
+    if (r < HEADER) {
+	errno = EPIPE;
+	return -1;
+    }
+    *n = ((size_t) h[0] << 24) | (h[1] << 16) | (h[2] << 8) | h[3];
+    *type = h[4];
+    if (*n > FRAME_MAX) {
+	errno = EMSGSIZE;
+	return -1;
+    }
+    if (*n > *nalloc) {
+	free(*buf);
+	*buf = malloc(*n);
+	if (!*buf) {
+	    *nalloc = 0;
+	    errno = ENOMEM;
+	    return -1;
+	}
+	*nalloc = *n;
+    }
+    r = read_all(fd, *buf, *n);
+    if (r == -1)
+	return -1;
+    if (r < *n) {
+	errno = EPIPE;
+	return -1;
+    }
+    return 1;
+}
@@ -0,0 +1,26 @@
+/*
+ * Copyright © 2005-2009 Bart Massey
+ * ALL RIGHTS RESERVED
+ * [This program is licensed under the "3-clause ('new') BSD License"]
+ * Please see the file COPYING in the source
+ * distribution of this software for license terms.
+ */
+
+/* Requests to a sketch server.  A hash is in the form of a
+   hash file; numbers are big-endian; names end with NUL. */
+#define OP_HASH 'h'      /* bytes: reply with their hash */
+#define OP_ADD 'a'       /* name, hash: keep it under name */
+#define OP_QUERY 'q'     /* 4-byte n, hash: reply with the n most
+			    similar, a "score name" line each */
+#define OP_COMPARE 'c'   /* name, name: reply with a score line */
+
+/* reply types */
+#define FRAME_OK 0
+#define FRAME_ERROR 1    /* the payload is a message */
+
+/* longest payload accepted */
+#define FRAME_MAX (256 * 1024 * 1024)
+
+extern int frame_write(int fd, int type, const void *buf, size_t n);
+extern int frame_read(int fd, int *type,
+		      unsigned char **buf, size_t *n, size_t *nalloc);
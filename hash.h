@@ -1,10 +0,0 @@
-/*
- * Copyright (c) 2005-2007 Bart Massey
- * ALL RIGHTS RESERVED
- * Please see the file COPYING in this directory for license information.
- */
-
-extern void hash_reset(int);
-extern int hash_contains(unsigned);
-extern void hash_insert(unsigned);
-extern int hash_delete(unsigned);
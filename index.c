@@ -0,0 +1,548 @@
+/*
+ * Copyright © 2005-2009 Bart Massey
+ * ALL RIGHTS RESERVED
+ * [This program is licensed under the "3-clause ('new') BSD License"]
+ * Please see the file COPYING in the source
+ * distribution of this software for license terms.
+ */
+
+/*
+ * Inverted indexes: for each feature of a set of
+ * shingleprints, the documents that have it, so that the
+ * documents most like a query are found by reading just
+ * the posting lists of the query's features.  An index is
+ * a run of segments, one for each batch of documents
+ * appended, each
+ *
+ *   a 64-byte header
+ *   a table of ndoc 8-byte document entries
+ *   the nterm distinct features, in increasing order
+ *   nterm + 1 offsets of their posting lists
+ *   the posting lists, each of increasing document
+ *   numbers within the segment
+ *   a table of NUL-terminated document names
+ *   padding to a 64-byte line
+ *
+ * all in the byte order of the machine that wrote it.
+ * Documents are numbered across the whole index in the
+ * order they were appended.  Segments are only ever
+ * appended, under a write lock; a segment cut short by a
+ * crash is ignored, and cut off by the next append.
+ *
+ * The number of postings a document shares with a query
+ * is the number of features they have in common, so it
+ * gives the document's score exactly, without looking at
+ * the document's shingleprint at all.
+ */
+
+#define _GNU_SOURCE
+#define _FILE_OFFSET_BITS 64
+#include <assert.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#include "sketch.h"
+#include "score.h"
+#include "match.h"
+#include "stats.h"
+#include "index.h"
+
+#define INDEX_MAGIC "simindx"
+#define INDEX_ORDER 0x01020304U
+#define INDEX_VERSION 1
+#define LINE 64
+
+struct index_header {
+    char magic[8];
+    unsigned order;      /* INDEX_ORDER, in the writer's order */
+    unsigned version;
+    unsigned family;     /* of every document */
+    unsigned nshingle;
+    unsigned ndoc;
+    unsigned nterm;      /* distinct features */
+    unsigned npost;      /* postings */
+    unsigned nnames;     /* size of the name table */
+    unsigned nline;      /* size of the segment, in lines */
+    char pad[LINE - 44];
+};
+
+struct index_doc {
+    unsigned name;       /* offset into the name table */
+    unsigned nfeature;
+};
+
+/* a segment of an open index, pointing into the map */
+struct index_segment {
+    int base;            /* number of its first document */
+    int ndoc;
+    unsigned nterm;
+    unsigned npost;
+    struct index_doc *doc;
+    unsigned *term;
+    unsigned *start;     /* of each term's postings */
+    unsigned *post;
+    char *names;
+};
+
+/* a feature of a document */
+struct posting {
+    unsigned feature;
+    unsigned doc;
+};
+
+static unsigned long lines(unsigned long n) {
+    return (n + LINE - 1) / LINE;
+}
+
+/* bytes of a segment before its padding */
+static unsigned long segment_bytes(struct index_header *h) {
+    return sizeof *h + (unsigned long) h->ndoc * sizeof(struct index_doc) +
+	(2 * (unsigned long) h->nterm + 1 + h->npost) * sizeof(unsigned) +
+	h->nnames;
+}
+
+/* Is the header at the start of the n bytes of a
+   segment a whole and sensible one?  Sizes are checked
+   against n before they are added up, so that the sum
+   can't overflow. */
+static int good_header(struct index_header *h, unsigned long n) {
+    return n >= sizeof *h &&
+	memcmp(h->magic, INDEX_MAGIC, sizeof INDEX_MAGIC) == 0 &&
+	h->order == INDEX_ORDER &&
+	h->version == INDEX_VERSION &&
+	h->nline > 0 && h->nline <= n / LINE &&
+	h->ndoc <= n / sizeof(struct index_doc) &&
+	h->nterm <= n / sizeof(unsigned) &&
+	h->npost <= n / sizeof(unsigned) &&
+	h->nnames <= n &&
+	segment_bytes(h) <= (unsigned long) h->nline * LINE;
+}
+
+static int lock_file(int fd, int type) {
+    struct flock fl;
+    memset(&fl, 0, sizeof fl);
+    fl.l_type = type;
+    fl.l_whence = SEEK_SET;
+    while (fcntl(fd, F_SETLKW, &fl) == -1)
+	if (errno != EINTR)
+	    return -1;
+    return 0;
+}
+
+/* Find the end of the whole segments of the open index
+   fd, setting *family and *nshingle from the first of
+   them, or to -1 if there are none.  Returns -1 after
+   complaining if the file isn't an index at all. */
+static off_t whole_segments(char *filename, int fd, int *family,
+			    int *nshingle) {
+    struct index_header h;
+    struct stat st;
+    off_t end = 0;
+    *family = -1;
+    *nshingle = -1;
+    if (fstat(fd, &st) == -1) {
+	perror(filename);
+	return -1;
+    }
+    while (st.st_size - end >= sizeof h) {
+	if (pread(fd, &h, sizeof h, end) != sizeof h) {
+	    perror(filename);
+	    return -1;
+	}
+	if (!good_header(&h, st.st_size - end))
+	    break;
+	if (*family == -1) {
+	    *family = h.family;
+	    *nshingle = h.nshingle;
+	}
+	end += (off_t) h.nline * LINE;
+    }
+    /* a short tail is left by a crash, but a file that
+       starts with anything else is something else */
+    if (end == 0 && st.st_size >= sizeof h &&
+	memcmp(h.magic, INDEX_MAGIC, sizeof INDEX_MAGIC) != 0) {
+	fprintf(stderr, "%s: not an index\n", filename);
+	return -1;
+    }
+    return end;
+}
+
+static int posting_cmp(const void *a, const void *b) {
+    const struct posting *x = a;
+    const struct posting *y = b;
+    if (x->feature != y->feature)
+	return x->feature < y->feature ? -1 : 1;
+    return x->doc < y->doc ? -1 : x->doc > y->doc;
+}
+
+/* Lay out a segment of the n shingleprints in his
+   (skipping null ones), named by names, in a fresh
+   buffer, setting *size to its length.  family and
+   nshingle are those of the index being appended to, or
+   -1.  Returns a null pointer after complaining if the
+   shingleprints can't go in the index. */
+static char *make_segment(char *filename, int n, char **names,
+			  hashinfo **his, int family, int nshingle,
+			  size_t *size) {
+    struct index_header h;
+    struct index_doc *docs;
+    struct posting *posts;
+    unsigned long npost = 0;
+    unsigned long nnames = 0;
+    unsigned *term, *start, *post;
+    unsigned *buf = 0;
+    int nbuf = 0;
+    char *seg, *name;
+    unsigned long p;
+    int i, d;
+    memset(&h, 0, sizeof h);
+    for (i = 0; i < n; i++) {
+	hashinfo *hi = his[i];
+	if (!hi)
+	    continue;
+	if (hi->nbits) {
+	    fprintf(stderr, "%s: can't index signatures\n", filename);
+	    return 0;
+	}
+	if (family == -1) {
+	    family = hi->family;
+	    nshingle = hi->nshingle;
+	}
+	if (hi->family != family || hi->nshingle != nshingle) {
+	    fprintf(stderr, "%s: %s: shingle kind, size or hash family "
+		    "differs from the index\n", filename, names[i]);
+	    return 0;
+	}
+	h.ndoc++;
+	npost += hi->nfeature;
+	nnames += strlen(names[i]) + 1;
+    }
+    /* nothing to add */
+    if (h.ndoc == 0) {
+	*size = 0;
+	return calloc(1, 1);
+    }
+    if (npost > 0xffffffffU || nnames > 0xffffffffU) {
+	errno = EFBIG;
+	perror(filename);
+	return 0;
+    }
+    posts = malloc(npost * sizeof posts[0]);
+    docs = malloc(h.ndoc * sizeof docs[0]);
+    assert((posts || npost == 0) && (docs || h.ndoc == 0));
+    npost = 0;
+    nnames = 0;
+    for (i = d = 0; i < n; i++) {
+	hashinfo *hi = his[i];
+	const unsigned *feature;
+	int j;
+	if (!hi)
+	    continue;
+	if (hi->coded && hi->nfeature > nbuf) {
+	    nbuf = hi->nfeature;
+	    free(buf);
+	    buf = malloc(nbuf * sizeof buf[0]);
+	    assert(buf);
+	}
+	feature = hash_features(hi, buf);
+	for (j = 0; j < hi->nfeature; j++) {
+	    posts[npost].feature = feature[j];
+	    posts[npost++].doc = d;
+	}
+	docs[d].name = nnames;
+	docs[d].nfeature = hi->nfeature;
+	nnames += strlen(names[i]) + 1;
+	d++;
+    }
+    free(buf);
+    qsort(posts, npost, sizeof posts[0], posting_cmp);
+    for (p = 0; p < npost; p++)
+	if (p == 0 || posts[p].feature != posts[p - 1].feature)
+	    h.nterm++;
+    strcpy(h.magic, INDEX_MAGIC);
+    h.order = INDEX_ORDER;
+    h.version = INDEX_VERSION;
+    h.family = family;
+    h.nshingle = nshingle;
+    h.npost = npost;
+    h.nnames = nnames;
+    if (lines(segment_bytes(&h)) > 0xffffffffU) {
+	free(posts);
+	free(docs);
+	errno = EFBIG;
+	perror(filename);
+	return 0;
+    }
+    h.nline = lines(segment_bytes(&h));
+    *size = (size_t) h.nline * LINE;
+    seg = calloc(*size, 1);
+    assert(seg);
+    memcpy(seg, &h, sizeof h);
+    memcpy(seg + sizeof h, docs, h.ndoc * sizeof docs[0]);
+    term = (unsigned *) (seg + sizeof h + h.ndoc * sizeof docs[0]);
+    start = term + h.nterm;
+    post = start + h.nterm + 1;
+    name = (char *) (post + h.npost);
+    h.nterm = 0;
+    for (p = 0; p < npost; p++) {
+	if (p == 0 || posts[p].feature != posts[p - 1].feature) {
+	    term[h.nterm] = posts[p].feature;
+	    start[h.nterm++] = p;
+	}
+	post[p] = posts[p].doc;
+    }
+    start[h.nterm] = npost;
+    for (i = 0; i < n; i++) {
+	size_t len;
+	if (!his[i])
+	    continue;
+	len = strlen(names[i]) + 1;
+	memcpy(name, names[i], len);
+	name += len;
+    }
+    free(posts);
+    free(docs);
+    return seg;
+}
+
+/* Append the n shingleprints in his (skipping null ones),
+   named by names, to the index in filename as a new
+   segment, making the index if need be.  Every
+   shingleprint in an index must have the same hash family
+   and shingle size.  Returns -1 after complaining on
+   failure. */
+int index_append(char *filename, int n, char **names, hashinfo **his) {
+    int family, nshingle;
+    size_t size, done = 0;
+    int result;
+    char *seg = 0;
+    off_t end;
+    int fd = open(filename, O_RDWR | O_CREAT, 0666);
+    if (fd == -1) {
+	perror(filename);
+	return -1;
+    }
+    if (lock_file(fd, F_WRLCK) == -1) {
+	perror(filename);
+	close(fd);
+	return -1;
+    }
+    end = whole_segments(filename, fd, &family, &nshingle);
+    if (end != -1)
+	seg = make_segment(filename, n, names, his, family, nshingle, &size);
+    if (!seg) {
+	close(fd);
+	return -1;
+    }
+    /* cut off anything left by a crash */
+    result = ftruncate(fd, end);
+    while (result == 0 && done < size) {
+	ssize_t r = pwrite(fd, seg + done, size - done, end + done);
+	if (r == -1 && errno != EINTR)
+	    result = -1;
+	else if (r > 0)
+	    done += r;
+    }
+    free(seg);
+    if (close(fd) == -1)
+	result = -1;
+    if (result == -1) {
+	perror(filename);
+	return -1;
+    }
+    return 0;
+}
+
+static invindex *bad_index(char *filename, invindex *x) {
+    fprintf(stderr, "%s: bad index\n", filename);
+    index_close(x);
+    return 0;
+}
+
+/* Map the index in filename.  Returns a null pointer
+   after complaining on failure. */
+invindex *index_open(char *filename) {
+    invindex *x;
+    struct stat st;
+    size_t pos = 0;
+    int nalloc = 0;
+    int fd = open(filename, O_RDONLY);
+    if (fd == -1) {
+	perror(filename);
+	return 0;
+    }
+    if (fstat(fd, &st) == -1) {
+	perror(filename);
+	close(fd);
+	return 0;
+    }
+    x = malloc(sizeof *x);
+    assert(x);
+    memset(x, 0, sizeof *x);
+    x->family = -1;
+    x->nshingle = -1;
+    x->size = st.st_size;
+    if (x->size > 0) {
+	x->map = mmap(0, x->size, PROT_READ, MAP_SHARED, fd, 0);
+	if (x->map == MAP_FAILED) {
+	    x->map = 0;
+	    perror(filename);
+	    close(fd);
+	    index_close(x);
+	    return 0;
+	}
+    }
+    close(fd);
+    /* segments past a bad one were never finished */
+    while (x->size - pos >= sizeof(struct index_header)) {
+	struct index_header *h =
+	    (struct index_header *) ((char *) x->map + pos);
+	struct index_segment *s;
+	int i;
+	if (!good_header(h, x->size - pos)) {
+	    if (pos == 0 && memcmp(h->magic, INDEX_MAGIC, sizeof INDEX_MAGIC))
+		return bad_index(filename, x);
+	    break;
+	}
+	if (x->family == -1) {
+	    x->family = h->family;
+	    x->nshingle = h->nshingle;
+	}
+	if (h->family != x->family || h->nshingle != x->nshingle ||
+	    h->ndoc > 0x7fffffff - x->ndoc)
+	    return bad_index(filename, x);
+	if (x->nseg >= nalloc) {
+	    nalloc = 2 * nalloc + 16;
+	    x->seg = realloc(x->seg, nalloc * sizeof x->seg[0]);
+	    assert(x->seg);
+	}
+	s = &x->seg[x->nseg++];
+	s->base = x->ndoc;
+	s->ndoc = h->ndoc;
+	s->nterm = h->nterm;
+	s->npost = h->npost;
+	s->doc = (struct index_doc *) (h + 1);
+	s->term = (unsigned *) (s->doc + s->ndoc);
+	s->start = s->term + s->nterm;
+	s->post = s->start + s->nterm + 1;
+	s->names = (char *) (s->post + s->npost);
+	if (s->start[0] != 0 || s->start[s->nterm] != s->npost ||
+	    (h->nnames > 0 && s->names[h->nnames - 1]))
+	    return bad_index(filename, x);
+	for (i = 0; i < s->ndoc; i++)
+	    if (s->doc[i].name >= h->nnames)
+		return bad_index(filename, x);
+	x->ndoc += s->ndoc;
+	if (s->ndoc > x->maxdoc)
+	    x->maxdoc = s->ndoc;
+	pos += (size_t) h->nline * LINE;
+    }
+    return x;
+}
+
+/* the first of term[lo .. n - 1] no less than v, or n */
+static unsigned lower_bound(const unsigned *term, unsigned lo, unsigned n,
+			    unsigned v) {
+    while (lo < n) {
+	unsigned mid = lo + (n - lo) / 2;
+	if (term[mid] < v)
+	    lo = mid + 1;
+	else
+	    n = mid;
+    }
+    return lo;
+}
+
+/* Find the ntop documents most like the shingleprint hi,
+   counting for each document the features of hi whose
+   postings it is in.  Leaves them, best first, in best,
+   which must have room for ntop, and returns how many
+   there are: only documents sharing a feature with hi are
+   found. */
+int index_query(invindex *x, hashinfo *hi, int ntop,
+		struct neighbour *best) {
+    unsigned *count;
+    int *touched;
+    unsigned *buf = 0;
+    const unsigned *feature;
+    unsigned long nscored = 0;
+    struct top t;
+    int i, n;
+    if (hi->coded) {
+	buf = malloc(hi->nfeature * sizeof buf[0]);
+	assert(buf);
+    }
+    feature = hash_features(hi, buf);
+    count = calloc(x->maxdoc + 1, sizeof count[0]);
+    touched = malloc((x->maxdoc + 1) * sizeof touched[0]);
+    assert(count && touched);
+    top_init(&t, 1, ntop);
+    for (i = 0; i < x->nseg; i++) {
+	struct index_segment *s = &x->seg[i];
+	unsigned lo = 0;
+	int ntouched = 0;
+	int j, k;
+	for (j = 0; j < hi->nfeature; j++) {
+	    unsigned p, end;
+	    lo = lower_bound(s->term, lo, s->nterm, feature[j]);
+	    if (lo == s->nterm)
+		break;
+	    if (s->term[lo] != feature[j])
+		continue;
+	    p = s->start[lo];
+	    end = s->start[lo + 1];
+	    if (end > s->npost)
+		end = s->npost;
+	    for (; p < end; p++) {
+		unsigned d = s->post[p];
+		if (d < s->ndoc && count[d]++ == 0)
+		    touched[ntouched++] = d;
+	    }
+	    lo++;
+	}
+	for (k = 0; k < ntouched; k++) {
+	    int d = touched[k];
+	    top_offer(&t, 0, s->base + d,
+		      overlap_score(count[d], hi->nfeature,
+				    s->doc[d].nfeature));
+	    count[d] = 0;
+	}
+	nscored += ntouched;
+    }
+    stats_scores(nscored);
+    n = t.n[0];
+    memcpy(best, t.best, n * sizeof best[0]);
+    top_free(&t);
+    free(count);
+    free(touched);
+    free(buf);
+    return n;
+}
+
+/* the name of document doc */
+char *index_name(invindex *x, int doc) {
+    int lo = 0, hi = x->nseg - 1;
+    struct index_segment *s;
+    while (lo < hi) {
+	int mid = (lo + hi + 1) / 2;
+	if (x->seg[mid].base <= doc)
+	    lo = mid;
+	else
+	    hi = mid - 1;
+    }
+    s = &x->seg[lo];
+    return s->names + s->doc[doc - s->base].name;
+}
+
+void index_close(invindex *x) {
+    if (x->map)
+	munmap(x->map, x->size);
+    free(x->seg);
+    free(x);
+}
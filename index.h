@@ -0,0 +1,29 @@
+/*
+ * Copyright © 2005-2009 Bart Massey
+ * ALL RIGHTS RESERVED
+ * [This program is licensed under the "3-clause ('new') BSD License"]
+ * Please see the file COPYING in the source
+ * distribution of this software for license terms.
+ */
+
+struct index_segment;
+
+/* an open inverted index */
+typedef struct invindex {
+    void *map;
+    size_t size;
+    int nseg;
+    struct index_segment *seg;
+    int ndoc;              /* in all the segments */
+    int family;            /* of every document, if any */
+    int nshingle;
+    int maxdoc;            /* most documents in a segment */
+} invindex;
+
+extern int index_append(char *filename, int n, char **names,
+			hashinfo **his);
+extern invindex *index_open(char *filename);
+extern int index_query(invindex *x, hashinfo *hi, int ntop,
+		       struct neighbour *best);
+extern char *index_name(invindex *x, int doc);
+extern void index_close(invindex *x);
@@ -0,0 +1,162 @@
+/*
+ * Copyright © 2005-2009 Bart Massey
+ * ALL RIGHTS RESERVED
+ * [This program is licensed under the "3-clause ('new') BSD License"]
+ * Please see the file COPYING in the source
+ * distribution of this software for license terms.
+ */
+
+/*
+ * Get the bytes of a file to a shingleprint context in
+ * as few, as large, contiguous pieces as possible.
+ * Regular files are mapped into memory and handed over
+ * whole; small ones, and anything else, are read in
+ * large blocks.  A
+ * compressed file, recognized by its first bytes, is
+ * decompressed on the way.
+ */
+
+#define _GNU_SOURCE
+#define _FILE_OFFSET_BITS 64
+#include <stdlib.h>
+#include <errno.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include "sketch.h"
+#include "input.h"
+#include "decomp.h"
+
+/* read size for files that can't be mapped */
+#define BLOCK (1024 * 1024)
+/* files no bigger than this are read rather than mapped:
+   for them, setting up and tearing down the mapping costs
+   more than copying */
+#define SMALL (64 * 1024)
+
+int input_decompress = 1;
+
+/* The compressed format of the regular file fd, judged by
+   its first bytes, or DECOMP_NONE. */
+int input_format(int fd) {
+    unsigned char magic[DECOMP_MAGIC];
+    ssize_t n;
+    if (!input_decompress)
+	return DECOMP_NONE;
+    n = pread(fd, magic, sizeof magic, 0);
+    if (n <= 0)
+	return DECOMP_NONE;
+    return decomp_format(magic, n);
+}
+
+/* Map bytes [start, end) of fd and feed them to ctx,
+   decompressed if they are a compressed file and whole
+   is set.  Returns 0 if the file can't be mapped, -1 if
+   it can't be decompressed. */
+static int map_range(simhash_ctx *ctx, int fd, off_t start, off_t end,
+		     int whole) {
+    off_t base = start & ~((off_t)sysconf(_SC_PAGESIZE) - 1);
+    size_t len = end - base;
+    unsigned char *m = mmap(0, len, PROT_READ, MAP_PRIVATE, fd, base);
+    unsigned char *p;
+    int format = DECOMP_NONE;
+    int r = 1;
+    if (m == MAP_FAILED)
+	return 0;
+    madvise(m, len, MADV_SEQUENTIAL);
+    p = m + (start - base);
+    if (whole && input_decompress)
+	format = decomp_format(p, end - start);
+    if (format != DECOMP_NONE) {
+	if (decomp_feed(ctx, format, p, end - start, -1) == -1)
+	    r = -1;
+    } else {
+	simhash_update(ctx, p, end - start);
+    }
+    munmap(m, len);
+    return r;
+}
+
+/* read bytes [start, end) of fd, or from the current
+   offset through EOF if end is negative, in large blocks
+   into ctx's buffer; in the latter case, a compressed
+   stream is decompressed */
+static int read_range(simhash_ctx *ctx, int fd, off_t start, off_t end) {
+    unsigned char *buf;
+    int first = end < 0 && input_decompress;
+    if (end >= 0 && lseek(fd, start, SEEK_SET) == -1)
+	return -1;
+    /* harmlessly fails on pipes */
+    posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+    if (!ctx->input)
+	ctx->input = malloc(BLOCK);
+    buf = ctx->input;
+    if (!buf)
+	return -1;
+    if (first) {
+	/* get enough of the start to know it by */
+	size_t have = 0;
+	int format;
+	while (have < DECOMP_MAGIC) {
+	    ssize_t n = read(fd, buf + have, BLOCK - have);
+	    if (n == 0)
+		break;
+	    if (n == -1) {
+		if (errno == EINTR)
+		    continue;
+		return -1;
+	    }
+	    have += n;
+	}
+	format = decomp_format(buf, have);
+	if (format != DECOMP_NONE)
+	    return decomp_feed(ctx, format, buf, have, fd);
+	if (have > 0)
+	    simhash_update(ctx, buf, have);
+    }
+    while (end < 0 || start < end) {
+	size_t want = BLOCK;
+	ssize_t n;
+	if (end >= 0 && want > end - start)
+	    want = end - start;
+	n = read(fd, buf, want);
+	if (n == 0 && end < 0)
+	    break;
+	if (n <= 0) {
+	    if (n == 0)
+		errno = EIO;  /* file shrank under us */
+	    else if (errno == EINTR)
+		continue;
+	    return -1;
+	}
+	simhash_update(ctx, buf, n);
+	start += n;
+    }
+    return 0;
+}
+
+/* feed everything remaining on fd to ctx */
+int input_file(simhash_ctx *ctx, int fd) {
+    struct stat st;
+    /* files of size 0 may just not know their size */
+    if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0) {
+	off_t start = lseek(fd, 0, SEEK_CUR);
+	if (start != -1 && start < st.st_size &&
+	    st.st_size - start > SMALL) {
+	    int r = map_range(ctx, fd, start, st.st_size, 1);
+	    if (r)
+		return r == 1 ? 0 : -1;
+	}
+    }
+    return read_range(ctx, fd, 0, -1);
+}
+
+/* feed bytes [start, end) of the regular file fd to ctx,
+   as they are */
+int input_range(simhash_ctx *ctx, int fd, off_t start, off_t end) {
+    if (start >= end || map_range(ctx, fd, start, end, 0))
+	return 0;
+    return read_range(ctx, fd, start, end);
+}
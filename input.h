@@ -0,0 +1,14 @@
+/*
+ * Copyright © 2005-2009 Bart Massey
+ * ALL RIGHTS RESERVED
+ * [This program is licensed under the "3-clause ('new') BSD License"]
+ * Please see the file COPYING in the source
+ * distribution of this software for license terms.
+ */
+
+/* decompress compressed files? */
+extern int input_decompress;
+
+extern int input_format(int fd);
+extern int input_file(simhash_ctx *ctx, int fd);
+extern int input_range(simhash_ctx *ctx, int fd, off_t start, off_t end);
@@ -0,0 +1,411 @@
+/*
+ * Copyright © 2005-2009 Bart Massey
+ * ALL RIGHTS RESERVED
+ * [This program is licensed under the "3-clause ('new') BSD License"]
+ * Please see the file COPYING in the source
+ * distribution of this software for license terms.
+ */
+
+/*
+ * Locality-sensitive hashing of shingleprints, to find
+ * the pairs worth scoring without scoring all of them.
+ *
+ * Each band has its own hash function h.  The band key of
+ * a shingleprint is the nrow smallest values of h over its
+ * features.  For two shingleprints with the same number
+ * of features, the smallest h over their union lies in
+ * their intersection with probability equal to their
+ * score s, so they share a band key with probability
+ * about s^nrow, and share at least one of nband keys with
+ * probability about 1 - (1 - s^nrow)^nband.  Pairs that
+ * share a key are the candidates; the caller checks them
+ * with the real score.
+ *
+ * Signatures are found by pigeonhole instead, as in
+ * Manku, Jain and Das Sarma, "Detecting near-duplicates
+ * for web crawling", WWW 2007.  Split the bits into g
+ * blocks: two signatures at most d bits apart differ in
+ * at most d blocks, so agree exactly on at least g - d
+ * of them.  A table keyed on each choice of g - d blocks
+ * misses no such pair.
+ */
+
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+#include "sketch.h"
+#include "pool.h"
+#include "lsh.h"
+
+/* one band key of one shingleprint */
+struct entry {
+    unsigned key[2];
+    int hash;
+};
+
+struct keying {
+    hashinfo **his;
+    int nband, nrow;
+    struct entry *entries;  /* nband per shingleprint */
+    unsigned **feature;     /* per worker, to decode coded ones into */
+    /* or, for signatures, the bits of them each band
+       (table) is keyed on */
+    unsigned (*mask)[SIG_MAXBITS / 32];
+};
+
+/* the MurmurHash3 finalizer */
+static unsigned mix32(unsigned h) {
+    h ^= h >> 16;
+    h *= 0x85ebca6bU;
+    h ^= h >> 13;
+    h *= 0xc2b2ae35U;
+    h ^= h >> 16;
+    return h;
+}
+
+/* key of band for the nfeature features, from the nrow
+   smallest of a band-specific hash of them */
+static void band_key(const unsigned *feature, int nfeature,
+		     int band, int nrow, unsigned key[2]) {
+    unsigned small[LSH_MAXROWS];
+    unsigned seed = (band + 1) * 0x9e3779b9U;
+    int n = 0;
+    int i, j;
+    for (i = 0; i < nfeature; i++) {
+	unsigned h = mix32(feature[i] ^ seed);
+	if (n == nrow && h >= small[n - 1])
+	    continue;
+	j = n < nrow ? n++ : nrow - 1;
+	for (; j > 0 && small[j - 1] > h; --j)
+	    small[j] = small[j - 1];
+	small[j] = h;
+    }
+    /* fold the band in, so that keys of different
+       bands never match */
+    key[0] = mix32(band);
+    key[1] = ~key[0];
+    for (i = 0; i < n; i++) {
+	key[0] = mix32(key[0] ^ small[i]);
+	key[1] = mix32(key[1] + small[i] * 0xcc9e2d51U);
+    }
+}
+
+/* key of table for the signature hi, from the bits of
+   it in mask */
+static void sig_key(hashinfo *hi, int table, const unsigned *mask,
+		    unsigned key[2]) {
+    int i;
+    key[0] = mix32(table);
+    key[1] = ~key[0];
+    for (i = 0; i < hi->nfeature; i++) {
+	unsigned v = hi->feature[i] & mask[i];
+	key[0] = mix32(key[0] ^ v);
+	key[1] = mix32(key[1] + v * 0xcc9e2d51U);
+    }
+}
+
+static void key_hash(void *arg, int job, int worker) {
+    struct keying *k = arg;
+    struct entry *e = &k->entries[job * k->nband];
+    hashinfo *hi = k->his[job];
+    const unsigned *feature = 0;
+    int b;
+    if (hi && !k->mask)
+	feature = hash_features(hi, k->feature ? k->feature[worker] : 0);
+    for (b = 0; b < k->nband; b++) {
+	e[b].hash = job;
+	if (!hi)
+	    continue;
+	if (k->mask)
+	    sig_key(hi, b, k->mask[b], e[b].key);
+	else
+	    band_key(feature, hi->nfeature, b, k->nrow, e[b].key);
+    }
+}
+
+/* by key, then hash */
+static int entry_cmp(const void *a, const void *b) {
+    const struct entry *x = a;
+    const struct entry *y = b;
+    if (x->key[0] != y->key[0])
+	return x->key[0] < y->key[0] ? -1 : 1;
+    if (x->key[1] != y->key[1])
+	return x->key[1] < y->key[1] ? -1 : 1;
+    return x->hash - y->hash;
+}
+
+static int pair_cmp(const void *a, const void *b) {
+    const lsh_pair *x = a;
+    const lsh_pair *y = b;
+    if (x->i != y->i)
+	return x->i - y->i;
+    return x->j - y->j;
+}
+
+/* sort pairs and drop duplicates, returning the new count */
+static int pair_unique(lsh_pair *pairs, int npairs) {
+    int i, n = 0;
+    qsort(pairs, npairs, sizeof pairs[0], pair_cmp);
+    for (i = 0; i < npairs; i++)
+	if (n == 0 || pair_cmp(&pairs[n - 1], &pairs[i]) != 0)
+	    pairs[n++] = pairs[i];
+    return n;
+}
+
+/* Key the n hashes of k on nworker threads, and call
+   fn with each run of hashes sharing a key, of at least
+   two.  The keys are all the memory needed, so it grows
+   only with n. */
+static void keyed_runs(struct keying *k, int n, int nworker,
+		       lsh_run_fn *fn, void *arg) {
+    hashinfo **his = k->his;
+    int nentry = n * k->nband;
+    int *run;
+    int i, j, r;
+    k->entries = malloc(nentry * sizeof k->entries[0]);
+    assert(k->entries || nentry == 0);
+    pool_run(nworker, n, key_hash, k);
+    /* hashes that didn't hash have no keys */
+    for (i = j = 0; i < nentry; i++)
+	if (his[k->entries[i].hash])
+	    k->entries[j++] = k->entries[i];
+    nentry = j;
+    qsort(k->entries, nentry, sizeof k->entries[0], entry_cmp);
+    run = malloc((n > 0 ? n : 1) * sizeof run[0]);
+    assert(run);
+    for (r = 0; r < nentry; r = i) {
+	for (i = r + 1; i < nentry; i++)
+	    if (k->entries[i].key[0] != k->entries[r].key[0] ||
+		k->entries[i].key[1] != k->entries[r].key[1])
+		break;
+	if (i - r < 2)
+	    continue;
+	for (j = r; j < i; j++)
+	    run[j - r] = k->entries[j].hash;
+	fn(arg, run, i - r);
+    }
+    free(run);
+    free(k->entries);
+}
+
+/* the candidate pairs found so far */
+struct gathered {
+    lsh_pair *p;
+    int np, maxp;
+};
+
+/* every pair within a run of equal keys is a candidate */
+static void gather_run(void *arg, const int *run, int nrun) {
+    struct gathered *g = arg;
+    int j, l;
+    for (j = 0; j < nrun; j++) {
+	for (l = j + 1; l < nrun; l++) {
+	    /* big runs of near-copies repeat the same
+	       pairs band after band: squeeze them out
+	       before growing */
+	    if (g->np == g->maxp) {
+		g->np = pair_unique(g->p, g->np);
+		if (g->np > g->maxp / 2) {
+		    g->maxp *= 2;
+		    g->p = realloc(g->p, g->maxp * sizeof g->p[0]);
+		    assert(g->p);
+		}
+	    }
+	    g->p[g->np].i = run[j];
+	    g->p[g->np].j = run[l];
+	    g->np++;
+	}
+    }
+}
+
+/* Key the n hashes of k on nworker threads, and return
+   the pairs that share a key as lsh_pairs() does. */
+static int keyed_pairs(struct keying *k, int n, int nworker,
+		       lsh_pair **pairs) {
+    struct gathered g;
+    g.np = 0;
+    g.maxp = 1024;
+    g.p = malloc(g.maxp * sizeof g.p[0]);
+    assert(g.p);
+    keyed_runs(k, n, nworker, gather_run, &g);
+    *pairs = g.p;
+    return pair_unique(g.p, g.np);
+}
+
+/* Set k up to key the n shingleprints in his with nband
+   bands of nrow rows, with room for nworker threads to
+   decode coded ones. */
+static void band_setup(struct keying *k, hashinfo **his, int n,
+		       int nband, int nrow, int nworker) {
+    int maxfeature = 1;
+    int coded = 0;
+    int i;
+    assert(nrow >= 1 && nrow <= LSH_MAXROWS && nband >= 1);
+    k->his = his;
+    k->nband = nband;
+    k->nrow = nrow;
+    k->feature = 0;
+    k->mask = 0;
+    for (i = 0; i < n; i++) {
+	if (!his[i])
+	    continue;
+	if (his[i]->nfeature > maxfeature)
+	    maxfeature = his[i]->nfeature;
+	coded |= his[i]->coded != 0;
+    }
+    if (coded) {
+	k->feature = malloc(nworker * sizeof k->feature[0]);
+	assert(k->feature);
+	for (i = 0; i < nworker; i++) {
+	    k->feature[i] = malloc(maxfeature * sizeof k->feature[i][0]);
+	    assert(k->feature[i]);
+	}
+    }
+}
+
+static void band_free(struct keying *k, int nworker) {
+    int i;
+    if (!k->feature)
+	return;
+    for (i = 0; i < nworker; i++)
+	free(k->feature[i]);
+    free(k->feature);
+}
+
+/* Find the candidate pairs among the n shingleprints in his
+   (null entries are skipped), computing keys on nworker
+   threads.  Sets *pairs to a malloced array of them, sorted
+   and without duplicates, and returns how many there are. */
+int lsh_pairs(hashinfo **his, int n, int nband, int nrow,
+	      int nworker, lsh_pair **pairs) {
+    struct keying k;
+    int np;
+    band_setup(&k, his, n, nband, nrow, nworker);
+    np = keyed_pairs(&k, n, nworker, pairs);
+    band_free(&k, nworker);
+    return np;
+}
+
+/* As lsh_pairs(), but rather than collect the pairs, call
+   fn with each run of shingleprints sharing a band key:
+   every pair in a run is a candidate.  A pair may turn
+   up in more than one run. */
+void lsh_runs(hashinfo **his, int n, int nband, int nrow,
+	      int nworker, lsh_run_fn *fn, void *arg) {
+    struct keying k;
+    band_setup(&k, his, n, nband, nrow, nworker);
+    keyed_runs(&k, n, nworker, fn, arg);
+    band_free(&k, nworker);
+}
+
+/* the number of ways of choosing d of g things, or
+   more than limit if it is */
+static unsigned long choose(int g, int d, unsigned long limit) {
+    unsigned long c = 1;
+    int i;
+    if (d > g - d)
+	d = g - d;
+    for (i = 1; i <= d; i++) {
+	c = c * (g - d + i) / i;
+	if (c > limit)
+	    return limit + 1;
+    }
+    return c;
+}
+
+/* Set up the tables for signatures of nbits bits at
+   most maxdist apart in k, returning how many there are.
+   The most blocks that need no more than maxtable tables
+   are used, and so the longest keys, since each table
+   keys on all but maxdist of the blocks. */
+static int sig_tables(struct keying *k, int nbits, int maxdist,
+		      int maxtable) {
+    int block[SIG_MAXBITS];   /* the blocks of a table */
+    int g = maxdist + 1;
+    int nkeep;
+    int i, t;
+    assert(nbits > 0 && nbits <= SIG_MAXBITS && maxdist >= 0);
+    k->nrow = 0;
+    k->feature = 0;
+    if (g > nbits) {
+	/* any two are close enough: one table, keyed
+	   on nothing */
+	k->nband = 1;
+	k->mask = calloc(1, sizeof k->mask[0]);
+	assert(k->mask);
+	return 1;
+    }
+    while (g < nbits && choose(g + 1, maxdist, maxtable) <= maxtable)
+	g++;
+    nkeep = g - maxdist;
+    k->nband = choose(g, maxdist, 0x7fffffffUL);
+    k->mask = calloc(k->nband, sizeof k->mask[0]);
+    assert(k->mask);
+    /* the tables' blocks, each choice in turn */
+    for (i = 0; i < nkeep; i++)
+	block[i] = i;
+    for (t = 0; t < k->nband; t++) {
+	for (i = 0; i < nkeep; i++) {
+	    int bit;
+	    for (bit = block[i] * nbits / g;
+		 bit < (block[i] + 1) * nbits / g; bit++)
+		k->mask[t][bit / 32] |= 1U << (bit % 32);
+	}
+	for (i = nkeep - 1; i >= 0 && block[i] == g - nkeep + i; --i)
+	    ;
+	if (i < 0)
+	    break;
+	block[i]++;
+	for (i++; i < nkeep; i++)
+	    block[i] = block[i - 1] + 1;
+    }
+    return k->nband;
+}
+
+/* About what fraction of unrelated pairs of signatures
+   lsh_sig_pairs() would make candidates: a table keyed
+   on b bits holds such a pair with probability 2^-b. */
+double lsh_sig_fraction(int nbits, int maxdist, int maxtable) {
+    struct keying k;
+    double f = 0;
+    int t, i;
+    sig_tables(&k, nbits, maxdist, maxtable);
+    for (t = 0; t < k.nband; t++) {
+	double p = 1;
+	for (i = 0; i < SIG_MAXBITS / 32; i++) {
+	    unsigned m;
+	    for (m = k.mask[t][i]; m; m &= m - 1)
+		p /= 2;
+	}
+	f += p;
+    }
+    free(k.mask);
+    return f < 1 ? f : 1;
+}
+
+/* Find the pairs among the n signatures of nbits bits in
+   his (null entries are skipped) that may be at most
+   maxdist bits apart, using at most maxtable tables if
+   that is enough: every pair that is will be found.
+   Returns the pairs as lsh_pairs() does. */
+int lsh_sig_pairs(hashinfo **his, int n, int nbits, int maxdist,
+		  int maxtable, int nworker, lsh_pair **pairs) {
+    struct keying k;
+    int np;
+    k.his = his;
+    sig_tables(&k, nbits, maxdist, maxtable);
+    np = keyed_pairs(&k, n, nworker, pairs);
+    free(k.mask);
+    return np;
+}
+
+/* As lsh_sig_pairs(), but call fn with each run of
+   signatures sharing a table key, as lsh_runs() does. */
+void lsh_sig_runs(hashinfo **his, int n, int nbits, int maxdist,
+		  int maxtable, int nworker, lsh_run_fn *fn, void *arg) {
+    struct keying k;
+    k.his = his;
+    sig_tables(&k, nbits, maxdist, maxtable);
+    keyed_runs(&k, n, nworker, fn, arg);
+    free(k.mask);
+}
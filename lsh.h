@@ -0,0 +1,29 @@
+/*
+ * Copyright © 2005-2009 Bart Massey
+ * ALL RIGHTS RESERVED
+ * [This program is licensed under the "3-clause ('new') BSD License"]
+ * Please see the file COPYING in the source
+ * distribution of this software for license terms.
+ */
+
+/* most rows per band */
+#define LSH_MAXROWS 64
+
+/* a candidate pair of hashes, i < j */
+typedef struct lsh_pair {
+    int i, j;
+} lsh_pair;
+
+/* called with the nrun hashes of a run sharing a key */
+typedef void lsh_run_fn(void *arg, const int *run, int nrun);
+
+extern int lsh_pairs(hashinfo **his, int n, int nband, int nrow,
+		     int nworker, lsh_pair **pairs);
+extern void lsh_runs(hashinfo **his, int n, int nband, int nrow,
+		     int nworker, lsh_run_fn *fn, void *arg);
+extern double lsh_sig_fraction(int nbits, int maxdist, int maxtable);
+extern int lsh_sig_pairs(hashinfo **his, int n, int nbits, int maxdist,
+			 int maxtable, int nworker, lsh_pair **pairs);
+extern void lsh_sig_runs(hashinfo **his, int n, int nbits, int maxdist,
+			 int maxtable, int nworker, lsh_run_fn *fn,
+			 void *arg);
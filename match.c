@@ -0,0 +1,622 @@
+/*
+ * Copyright © 2005-2009 Bart Massey
+ * ALL RIGHTS RESERVED
+ * [This program is licensed under the "3-clause ('new') BSD License"]
+ * Please see the file COPYING in the source
+ * distribution of this software for license terms.
+ */
+
+/*
+ * Match mode output: the similarity matrix, each file's
+ * best neighbours, the pairs above a threshold, or the
+ * groups of files joined by such pairs.
+ *
+ * The matrix is scored a block of rows at a time, each
+ * block against a tile of columns at a time, so that the
+ * tile stays in cache while the rows are scored against
+ * it.  Rows are printed as soon as their block is done,
+ * so memory is the shingleprints plus one block of rows,
+ * however many files there are.  Lines are formatted
+ * into a buffer and written whole.  Coded shingleprints
+ * stay coded in memory: each worker decodes its tile,
+ * and a row at a time, into its own scratch space.
+ */
+
+#include <assert.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "sketch.h"
+#include "score.h"
+#include "pool.h"
+#include "lsh.h"
+#include "match.h"
+#include "stats.h"
+
+/* most bytes of scores in a block of rows */
+#define BLOCK_BYTES (16 * 1024 * 1024)
+/* the most of all pairs of signatures the tables may
+   make candidates before it is cheaper to score them all */
+#define SIG_MAX_FRACTION 0.01
+
+static int width(int n) {
+    int i = 0;
+    int k = 1;
+    while (k <= n) {
+	k *= 10;
+	i++;
+    }
+    return i;
+}
+
+static int format_spaces(char *buf, int n) {
+    if (n <= 0)
+	return 0;
+    memset(buf, ' ', n);
+    return n;
+}
+
+/* Format s right-justified in fieldwidth into buf,
+   returning the number of characters: a score of -1
+   means there isn't one. */
+int format_score(char *buf, int fieldwidth, double s) {
+    int n = format_spaces(buf, fieldwidth - SCORE_CHARS);
+    if (s == -1) {
+	memcpy(buf + n, " ? ", 3);
+    } else if (s == 1.0) {
+	memcpy(buf + n, "1.0", 3);
+    } else {
+	int pct = (int)floor(s * 100);
+	buf[n] = '.';
+	buf[n + 1] = '0' + pct / 10;
+	buf[n + 2] = '0' + pct % 10;
+    }
+    return n + 3;
+}
+
+static int format_index(char *buf, int fieldwidth, int value) {
+    int n = format_spaces(buf, fieldwidth - width(value));
+    return n + sprintf(buf + n, "%d", value);
+}
+
+/* a worker's room to decode a tile and a row into */
+struct scratch {
+    hashinfo *his;      /* the tile's, then the row's */
+    hashinfo **tile;
+    unsigned *feature;  /* maxfeature for each of his */
+};
+
+/* a block of rows to be scored */
+struct block {
+    hashinfo **his;
+    int r0, r1;         /* rows r0 .. r1 - 1 */
+    double **rows;      /* row i is rows[i - r0] */
+    int tile;           /* columns per tile */
+    int maxfeature;
+    struct scratch *scratch;  /* per worker, if any hash is coded */
+    int nscratch;
+};
+
+/* hi, or if it is coded a copy of it decoded into h
+   and feature */
+static hashinfo *decoded(hashinfo *hi, hashinfo *h, unsigned *feature) {
+    if (!hi || !hi->coded)
+	return hi;
+    *h = *hi;
+    delta_get(hi->coded, feature, hi->nfeature);
+    h->feature = feature;
+    h->coded = 0;
+    return h;
+}
+
+/* score the block's rows against tile job, in the
+   lower triangle */
+static void score_block_tile(void *arg, int job, int worker) {
+    struct block *b = arg;
+    struct scratch *s = b->scratch ? &b->scratch[worker] : 0;
+    int j0 = job * b->tile;
+    hashinfo **tile = b->his + j0;
+    int i, j;
+    if (s) {
+	/* the last row scores the most columns */
+	int ncol = b->r1 - 1 - j0;
+	if (ncol > b->tile)
+	    ncol = b->tile;
+	for (j = 0; j < ncol; j++)
+	    s->tile[j] = decoded(tile[j], &s->his[j],
+				 s->feature + (size_t) j * b->maxfeature);
+	tile = s->tile;
+    }
+    for (i = b->r0; i < b->r1; i++) {
+	hashinfo *hi = b->his[i];
+	int n = i - j0;
+	if (n <= 0)
+	    continue;
+	if (n > b->tile)
+	    n = b->tile;
+	if (s)
+	    hi = decoded(hi, &s->his[b->tile],
+			 s->feature + (size_t) b->tile * b->maxfeature);
+	score_tile(hi, tile, n, &b->rows[i - b->r0][j0]);
+    }
+}
+
+static void score_block(struct block *b, int nworker) {
+    int ntile = (b->r1 - 1 + b->tile - 1) / b->tile;
+    pool_run(nworker, ntile, score_block_tile, b);
+    /* rows r0 .. r1 - 1 each score all the rows before */
+    stats_scores(((unsigned long) b->r0 + b->r1 - 1) * (b->r1 - b->r0) / 2);
+}
+
+/* the most features of any of the n hashes his, and
+   whether any of them is coded */
+static int max_features(int n, hashinfo **his, int *coded) {
+    int maxfeature = 1;
+    int i;
+    *coded = 0;
+    for (i = 0; i < n; i++) {
+	if (!his[i])
+	    continue;
+	if (his[i]->nfeature > maxfeature)
+	    maxfeature = his[i]->nfeature;
+	*coded |= his[i]->coded != 0;
+    }
+    return maxfeature;
+}
+
+/* set up to score n hashes a block of rows at a time
+   on nworker threads, returning the number of rows per
+   block */
+static int start_blocks(struct block *b, int n, hashinfo **his,
+			int nworker) {
+    int coded;
+    int maxfeature = max_features(n, his, &coded);
+    int nrows;
+    int i;
+    b->his = his;
+    b->tile = score_tile_size(maxfeature);
+    b->maxfeature = maxfeature;
+    b->scratch = 0;
+    b->nscratch = coded ? nworker : 0;
+    if (coded) {
+	b->scratch = malloc(nworker * sizeof b->scratch[0]);
+	assert(b->scratch);
+	for (i = 0; i < nworker; i++) {
+	    struct scratch *s = &b->scratch[i];
+	    s->his = malloc((b->tile + 1) * sizeof s->his[0]);
+	    s->tile = malloc(b->tile * sizeof s->tile[0]);
+	    s->feature = malloc((size_t) (b->tile + 1) * maxfeature *
+				sizeof s->feature[0]);
+	    assert(s->his && s->tile && s->feature);
+	}
+    }
+    nrows = BLOCK_BYTES / (n * sizeof(double));
+    if (nrows > b->tile)
+	nrows = b->tile;
+    if (nrows < 1)
+	nrows = 1;
+    b->rows = malloc(nrows * sizeof b->rows[0]);
+    assert(b->rows);
+    for (i = 0; i < nrows; i++) {
+	b->rows[i] = malloc(n * sizeof b->rows[i][0]);
+	assert(b->rows[i]);
+    }
+    return nrows;
+}
+
+static void end_blocks(struct block *b, int nrows) {
+    int i;
+    for (i = 0; i < nrows; i++)
+	free(b->rows[i]);
+    free(b->rows);
+    for (i = 0; i < b->nscratch; i++) {
+	free(b->scratch[i].his);
+	free(b->scratch[i].tile);
+	free(b->scratch[i].feature);
+    }
+    free(b->scratch);
+}
+
+/* Print the lower triangle of the similarity matrix of
+   the n hashes his, labeled with names. */
+void match_matrix(FILE *f, int n, char **names, hashinfo **his,
+		  int nworker) {
+    struct block b;
+    int nfilename = 0;
+    int fieldwidth;
+    int nrows;
+    char *line;
+    int i, j, len;
+    /* find maximum filename length */
+    for (i = 0; i < n; i++) {
+	int l = strlen(names[i]);
+	if (l > nfilename)
+	    nfilename = l;
+    }
+    /* find the field width */
+    fieldwidth = width(n);
+    if (fieldwidth < SCORE_CHARS)
+	fieldwidth = SCORE_CHARS;
+    line = malloc(nfilename + 2 + (n + 2) * (fieldwidth + 2));
+    assert(line);
+    /* print the first row of indices */
+    stats_phase(PHASE_OUTPUT);
+    len = format_spaces(line, nfilename + fieldwidth + 1);
+    for (i = 1; i < n - 1; i++) {
+	len += format_index(line + len, fieldwidth, i);
+	line[len++] = ' ';
+    }
+    len += format_index(line + len, fieldwidth, n - 1);
+    line[len++] = '\n';
+    fwrite(line, 1, len, f);
+    /* print the rows of the matrix as they are scored */
+    nrows = start_blocks(&b, n, his, nworker);
+    for (b.r0 = 0; b.r0 < n; b.r0 = b.r1) {
+	b.r1 = b.r0 + nrows;
+	if (b.r1 > n)
+	    b.r1 = n;
+	stats_phase(PHASE_SCORE);
+	score_block(&b, nworker);
+	stats_phase(PHASE_OUTPUT);
+	for (i = b.r0; i < b.r1; i++) {
+	    double *row = b.rows[i - b.r0];
+	    len = strlen(names[i]);
+	    memcpy(line, names[i], len);
+	    len += format_spaces(line + len, nfilename + 1 - len);
+	    len += format_index(line + len, fieldwidth, i + 1);
+	    for (j = 0; j < i; j++) {
+		line[len++] = ' ';
+		len += format_score(line + len, fieldwidth, row[j]);
+	    }
+	    line[len++] = '\n';
+	    fwrite(line, 1, len, f);
+	}
+    }
+    end_blocks(&b, nrows);
+    free(line);
+}
+
+void top_init(struct top *t, int n, int ntop) {
+    t->ntop = ntop;
+    t->n = calloc(n, sizeof t->n[0]);
+    t->best = malloc((size_t) n * ntop * sizeof t->best[0]);
+    assert(t->n && t->best);
+}
+
+void top_free(struct top *t) {
+    free(t->n);
+    free(t->best);
+}
+
+/* higher score first, then lower index, so that
+   the output doesn't depend on the order of offers */
+static int better(double s, int j, struct neighbour *nb) {
+    return s > nb->score || (s == nb->score && j < nb->hash);
+}
+
+/* j, with score s, may be one of i's best */
+void top_offer(struct top *t, int i, int j, double s) {
+    struct neighbour *best = &t->best[(size_t) i * t->ntop];
+    int n = t->n[i];
+    int k;
+    if (n == t->ntop && !better(s, j, &best[n - 1]))
+	return;
+    k = n < t->ntop ? n++ : n - 1;
+    for (; k > 0 && better(s, j, &best[k - 1]); --k)
+	best[k] = best[k - 1];
+    best[k].score = s;
+    best[k].hash = j;
+    t->n[i] = n;
+}
+
+/* print each hash's best neighbours, best first */
+static void top_print(FILE *f, struct top *t, int n, char **names) {
+    char buf[SCORE_CHARS];
+    int i, k;
+    for (i = 0; i < n; i++) {
+	struct neighbour *best = &t->best[(size_t) i * t->ntop];
+	for (k = 0; k < t->n[i]; k++) {
+	    fwrite(buf, 1, format_score(buf, 0, best[k].score), f);
+	    fprintf(f, " %s %s\n", names[i], names[best[k].hash]);
+	}
+    }
+}
+
+/* Print the ntop best neighbours of each of the n hashes
+   his, scoring every pair. */
+void match_top(FILE *f, int n, char **names, hashinfo **his,
+	       int ntop, int nworker) {
+    struct block b;
+    struct top t;
+    int nrows;
+    int i, j;
+    stats_phase(PHASE_SCORE);
+    top_init(&t, n, ntop);
+    nrows = start_blocks(&b, n, his, nworker);
+    for (b.r0 = 0; b.r0 < n; b.r0 = b.r1) {
+	b.r1 = b.r0 + nrows;
+	if (b.r1 > n)
+	    b.r1 = n;
+	score_block(&b, nworker);
+	for (i = b.r0; i < b.r1; i++) {
+	    double *row = b.rows[i - b.r0];
+	    for (j = 0; j < i; j++) {
+		if (row[j] == -1)
+		    continue;
+		top_offer(&t, i, j, row[j]);
+		top_offer(&t, j, i, row[j]);
+	    }
+	}
+    }
+    end_blocks(&b, nrows);
+    stats_phase(PHASE_OUTPUT);
+    top_print(f, &t, n, names);
+    top_free(&t);
+}
+
+/* the bits of the first of the n hashes his that is a
+   signature, or 0 if none is */
+static int sig_bits(int n, hashinfo **his) {
+    int i;
+    for (i = 0; i < n; i++)
+	if (his[i] && his[i]->nbits)
+	    return his[i]->nbits;
+    return 0;
+}
+
+/* the most bits signatures of nbits bits can differ in
+   and still score at least threshold */
+static int sig_maxdist(double threshold, int nbits) {
+    int d = 0;
+    while (d < nbits && sig_score(d + 1, nbits) >= threshold)
+	d++;
+    return d;
+}
+
+static int pair_cmp(const void *a, const void *b) {
+    const lsh_pair *x = a;
+    const lsh_pair *y = b;
+    if (x->i != y->i)
+	return x->i - y->i;
+    return x->j - y->j;
+}
+
+/* Find the pairs of the n hashes his scoring at least
+   threshold by scoring them all, a block at a time.
+   Returns them as lsh_pairs() does. */
+static int scored_pairs(int n, hashinfo **his, double threshold,
+			int nworker, lsh_pair **pairs) {
+    struct block b;
+    lsh_pair *p;
+    int np = 0;
+    int maxp = 1024;
+    int nrows = start_blocks(&b, n, his, nworker);
+    int i, j;
+    p = malloc(maxp * sizeof p[0]);
+    assert(p);
+    for (b.r0 = 0; b.r0 < n; b.r0 = b.r1) {
+	b.r1 = b.r0 + nrows;
+	if (b.r1 > n)
+	    b.r1 = n;
+	score_block(&b, nworker);
+	for (i = b.r0; i < b.r1; i++) {
+	    double *row = b.rows[i - b.r0];
+	    for (j = 0; j < i; j++) {
+		if (row[j] == -1 || row[j] < threshold)
+		    continue;
+		if (np == maxp) {
+		    maxp *= 2;
+		    p = realloc(p, maxp * sizeof p[0]);
+		    assert(p);
+		}
+		p[np].i = j;
+		p[np].j = i;
+		np++;
+	    }
+	}
+    }
+    end_blocks(&b, nrows);
+    qsort(p, np, sizeof p[0], pair_cmp);
+    *pairs = p;
+    return np;
+}
+
+/* Print the pairs of the n hashes his scoring at least
+   threshold, scoring only the LSH candidates found with
+   nband bands of nrow rows.  Signatures are found with
+   up to nband tables instead, which miss nothing, unless
+   the tables would hardly narrow things down.  If ntop is
+   positive, print only each hash's ntop best such
+   neighbours. */
+void match_pairs(FILE *f, int n, char **names, hashinfo **his,
+		 double threshold, int nband, int nrow,
+		 int ntop, int nworker) {
+    char buf[SCORE_CHARS];
+    struct top t;
+    lsh_pair *pairs;
+    double *scores;
+    hashinfo row, *hi = 0;
+    unsigned *feature = 0;
+    int npairs;
+    int coded;
+    int maxfeature = max_features(n, his, &coded);
+    int nbits = sig_bits(n, his);
+    int i;
+    stats_phase(PHASE_SCORE);
+    if (!nbits)
+	npairs = lsh_pairs(his, n, nband, nrow, nworker, &pairs);
+    else if (lsh_sig_fraction(nbits, sig_maxdist(threshold, nbits),
+			      nband) > SIG_MAX_FRACTION)
+	npairs = scored_pairs(n, his, threshold, nworker, &pairs);
+    else
+	npairs = lsh_sig_pairs(his, n, nbits, sig_maxdist(threshold, nbits),
+			       nband, nworker, &pairs);
+    scores = malloc(npairs * sizeof scores[0]);
+    assert(scores || npairs == 0);
+    /* the pairs come a run of the same first hash at a
+       time: decode it just once for the run */
+    if (coded) {
+	feature = malloc(maxfeature * sizeof feature[0]);
+	assert(feature);
+    }
+    for (i = 0; i < npairs; i++) {
+	if (i == 0 || pairs[i].i != pairs[i - 1].i)
+	    hi = decoded(his[pairs[i].i], &row, feature);
+	scores[i] = score(hi, his[pairs[i].j]);
+    }
+    free(feature);
+    stats_scores(npairs);
+    if (ntop > 0) {
+	top_init(&t, n, ntop);
+	for (i = 0; i < npairs; i++) {
+	    if (scores[i] < threshold)
+		continue;
+	    top_offer(&t, pairs[i].i, pairs[i].j, scores[i]);
+	    top_offer(&t, pairs[i].j, pairs[i].i, scores[i]);
+	}
+    }
+    stats_phase(PHASE_OUTPUT);
+    if (ntop > 0) {
+	top_print(f, &t, n, names);
+	top_free(&t);
+    } else {
+	for (i = 0; i < npairs; i++) {
+	    if (scores[i] < threshold)
+		continue;
+	    fwrite(buf, 1, format_score(buf, 0, scores[i]), f);
+	    fprintf(f, " %s %s\n", names[pairs[i].i], names[pairs[i].j]);
+	}
+    }
+    free(scores);
+    free(pairs);
+}
+
+/* groups of near-copies, as a forest of hashes: each
+   group is a tree, named by its root */
+struct clustering {
+    hashinfo **his;
+    double threshold;
+    int *parent;
+    int *size;                 /* of each root's group */
+    unsigned long nscored;
+};
+
+static int find_root(struct clustering *c, int i) {
+    while (c->parent[i] != i) {
+	c->parent[i] = c->parent[c->parent[i]];
+	i = c->parent[i];
+    }
+    return i;
+}
+
+/* join the groups of roots a and b, the smaller under
+   the bigger */
+static void join(struct clustering *c, int a, int b) {
+    if (c->size[a] < c->size[b]) {
+	int t = a;
+	a = b;
+	b = t;
+    }
+    c->parent[b] = a;
+    c->size[a] += c->size[b];
+}
+
+/* Score the pairs of a run of candidates that aren't
+   already in the same group, joining the groups of those
+   scoring at least the threshold.  Once two groups are
+   joined, no more of their pairs are scored; a run all
+   in one group is passed over at a glance. */
+static void cluster_run(void *arg, const int *run, int nrun) {
+    struct clustering *c = arg;
+    int r = find_root(c, run[0]);
+    int j, l;
+    for (l = 1; l < nrun; l++)
+	if (find_root(c, run[l]) != r)
+	    break;
+    for (; l < nrun; l++) {
+	for (j = 0; j < l; j++) {
+	    int a = find_root(c, run[j]);
+	    int b = find_root(c, run[l]);
+	    if (a == b)
+		continue;
+	    c->nscored++;
+	    if (score(c->his[run[j]], c->his[run[l]]) >= c->threshold)
+		join(c, a, b);
+	}
+    }
+}
+
+/* Print each group of more than one hash on a line, its
+   names in order, the groups in order of their first. */
+static void cluster_print(FILE *f, struct clustering *c, int n,
+			  char **names) {
+    int *first = malloc(n * sizeof first[0]);
+    int *next = malloc(n * sizeof next[0]);
+    int i, k;
+    assert(first && next);
+    for (i = 0; i < n; i++)
+	first[i] = -1;
+    for (i = n - 1; i >= 0; --i) {
+	int r = find_root(c, i);
+	next[i] = first[r];
+	first[r] = i;
+    }
+    for (i = 0; i < n; i++) {
+	if (first[find_root(c, i)] != i || next[i] == -1)
+	    continue;
+	fputs(names[i], f);
+	for (k = next[i]; k != -1; k = next[k])
+	    fprintf(f, " %s", names[k]);
+	putc('\n', f);
+    }
+    free(first);
+    free(next);
+}
+
+/* Print the groups of the n hashes his joined by pairs
+   scoring at least threshold, found among the LSH
+   candidates with nband bands of nrow rows, or for
+   signatures with up to nband tables, as match_pairs()
+   does.  Groups are joined as pairs are scored, rather
+   than the pairs kept, so memory grows only with n. */
+void match_clusters(FILE *f, int n, char **names, hashinfo **his,
+		    double threshold, int nband, int nrow, int nworker) {
+    struct clustering c;
+    int nbits = sig_bits(n, his);
+    int i;
+    stats_phase(PHASE_SCORE);
+    c.his = his;
+    c.threshold = threshold;
+    c.parent = malloc(n * sizeof c.parent[0]);
+    c.size = malloc(n * sizeof c.size[0]);
+    assert(c.parent && c.size);
+    c.nscored = 0;
+    for (i = 0; i < n; i++) {
+	c.parent[i] = i;
+	c.size[i] = 1;
+    }
+    if (!nbits) {
+	lsh_runs(his, n, nband, nrow, nworker, cluster_run, &c);
+    } else if (lsh_sig_fraction(nbits, sig_maxdist(threshold, nbits),
+				nband) > SIG_MAX_FRACTION) {
+	/* every pair is a candidate */
+	int *all = malloc(n * sizeof all[0]);
+	int nall = 0;
+	assert(all);
+	for (i = 0; i < n; i++)
+	    if (his[i])
+		all[nall++] = i;
+	if (nall > 1)
+	    cluster_run(&c, all, nall);
+	free(all);
+    } else {
+	lsh_sig_runs(his, n, nbits, sig_maxdist(threshold, nbits),
+		     nband, nworker, cluster_run, &c);
+    }
+    stats_scores(c.nscored);
+    stats_phase(PHASE_OUTPUT);
+    cluster_print(f, &c, n, names);
+    free(c.parent);
+    free(c.size);
+}
@@ -0,0 +1,38 @@
+/*
+ * Copyright © 2005-2009 Bart Massey
+ * ALL RIGHTS RESERVED
+ * [This program is licensed under the "3-clause ('new') BSD License"]
+ * Please see the file COPYING in the source
+ * distribution of this software for license terms.
+ */
+
+/* longest formatted score */
+#define SCORE_CHARS 3
+
+/* a hash and how much like it is */
+struct neighbour {
+    double score;
+    int hash;
+};
+
+/* the best neighbours so far of each of n hashes */
+struct top {
+    int ntop;
+    int *n;                    /* how many each has */
+    struct neighbour *best;    /* ntop each, best first */
+};
+
+extern void top_init(struct top *t, int n, int ntop);
+extern void top_free(struct top *t);
+extern void top_offer(struct top *t, int i, int j, double s);
+extern int format_score(char *buf, int fieldwidth, double s);
+extern void match_matrix(FILE *f, int n, char **names, hashinfo **his,
+			 int nworker);
+extern void match_top(FILE *f, int n, char **names, hashinfo **his,
+		      int ntop, int nworker);
+extern void match_pairs(FILE *f, int n, char **names, hashinfo **his,
+			double threshold, int nband, int nrow,
+			int ntop, int nworker);
+extern void match_clusters(FILE *f, int n, char **names, hashinfo **his,
+			   double threshold, int nband, int nrow,
+			   int nworker);
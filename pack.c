@@ -0,0 +1,325 @@
+/*
+ * Copyright © 2005-2009 Bart Massey
+ * ALL RIGHTS RESERVED
+ * [This program is licensed under the "3-clause ('new') BSD License"]
+ * Please see the file COPYING in the source
+ * distribution of this software for license terms.
+ */
+
+/*
+ * Sketch packs: many shingleprints in one file, laid out
+ * to be mapped and used in place.  A pack is
+ *
+ *   a 64-byte header
+ *   a table of ndoc 16-byte document entries
+ *   a table of NUL-terminated document names
+ *   each document's features, starting on a 64-byte line
+ *
+ * all in the byte order of the machine that wrote it.
+ * A pack from a machine of the other byte order is
+ * byte-swapped in a private copy of the mapping.  A
+ * document whose version has FILE_DELTA has the code
+ * of its features instead, as bytes, and stays coded;
+ * at least DELTA_SLACK bytes of padding follow it.  A
+ * signature's words take the place of features.
+ */
+
+#define _GNU_SOURCE
+#define _FILE_OFFSET_BITS 64
+#include <assert.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include "sketch.h"
+#include "pack.h"
+
+#define PACK_MAGIC "simpack"
+#define PACK_ORDER 0x01020304U
+#define PACK_VERSION 1
+#define LINE 64
+
+struct pack_header {
+    char magic[8];
+    unsigned order;      /* PACK_ORDER, in the writer's order */
+    unsigned version;
+    unsigned ndoc;
+    unsigned docs;       /* offset of the document table */
+    unsigned names;      /* offset of the name table */
+    unsigned nnames;     /* size of the name table */
+    char pad[LINE - 32];
+};
+
+struct pack_doc {
+    unsigned short version;  /* as at the start of a hash file */
+    unsigned short nshingle;
+    unsigned nfeature;
+    unsigned name;           /* offset into the name table */
+    unsigned feature;        /* offset of the features, in lines */
+};
+
+static unsigned long lines(unsigned long n) {
+    return (n + LINE - 1) / LINE;
+}
+
+/* bytes of hi's features, as they go in a pack */
+static size_t feature_bytes(hashinfo *hi) {
+    if (hi->coded)
+	return delta_length(hi->coded, hi->nfeature);
+    return hi->nfeature * sizeof hi->feature[0];
+}
+
+/* lines for hi's features and any padding they need */
+static unsigned long feature_lines(hashinfo *hi) {
+    return lines(feature_bytes(hi) + (hi->coded ? DELTA_SLACK : 0));
+}
+
+/* Write the n shingleprints in his (skipping null ones)
+   to f as a pack, named by names.  Returns -1 with errno
+   set on failure. */
+int pack_write(FILE *f, int n, char **names, hashinfo **his) {
+    static char zero[LINE];
+    struct pack_header h;
+    struct pack_doc *docs;
+    unsigned long nnames = 0;
+    unsigned long line;
+    int ndoc = 0;
+    int i, d;
+    for (i = 0; i < n; i++) {
+	if (!his[i])
+	    continue;
+	ndoc++;
+	nnames += strlen(names[i]) + 1;
+    }
+    if (ndoc > (0xffffffffU - sizeof h) / sizeof *docs) {
+	errno = EFBIG;
+	return -1;
+    }
+    memset(&h, 0, sizeof h);
+    strcpy(h.magic, PACK_MAGIC);
+    h.order = PACK_ORDER;
+    h.version = PACK_VERSION;
+    h.ndoc = ndoc;
+    h.docs = sizeof h;
+    h.names = h.docs + ndoc * sizeof *docs;
+    h.nnames = nnames;
+    if (nnames != h.nnames || h.names + nnames < h.names) {
+	errno = EFBIG;
+	return -1;
+    }
+    docs = malloc(ndoc * sizeof *docs);
+    assert(docs || ndoc == 0);
+    line = lines(h.names + nnames);
+    nnames = 0;
+    for (i = d = 0; i < n; i++) {
+	if (!his[i])
+	    continue;
+	docs[d].version = FILE_MAGIC | his[i]->family |
+	    (his[i]->nbits ? FILE_BITSIG : FILE_ASCENDING);
+	if (his[i]->coded)
+	    docs[d].version |= FILE_DELTA;
+	docs[d].nshingle = his[i]->nshingle;
+	docs[d].nfeature = his[i]->nfeature;
+	docs[d].name = nnames;
+	docs[d].feature = line;
+	if (docs[d].feature != line) {
+	    free(docs);
+	    errno = EFBIG;
+	    return -1;
+	}
+	nnames += strlen(names[i]) + 1;
+	line += feature_lines(his[i]);
+	d++;
+    }
+    fwrite(&h, sizeof h, 1, f);
+    fwrite(docs, sizeof *docs, ndoc, f);
+    free(docs);
+    for (i = 0; i < n; i++)
+	if (his[i])
+	    fwrite(names[i], strlen(names[i]) + 1, 1, f);
+    fwrite(zero, LINE * lines(h.names + h.nnames) - (h.names + h.nnames),
+	   1, f);
+    for (i = 0; i < n; i++) {
+	size_t size;
+	if (!his[i])
+	    continue;
+	size = feature_bytes(his[i]);
+	if (his[i]->coded)
+	    fwrite(his[i]->coded, size, 1, f);
+	else
+	    fwrite(his[i]->feature, size, 1, f);
+	fwrite(zero, LINE * feature_lines(his[i]) - size, 1, f);
+    }
+    if (fflush(f) == EOF || ferror(f))
+	return -1;
+    return 0;
+}
+
+static unsigned swap32(unsigned x) {
+    return (x >> 24) | ((x >> 8) & 0xff00) |
+	((x << 8) & 0xff0000) | (x << 24);
+}
+
+static unsigned short swap16(unsigned short x) {
+    return (x >> 8) | ((x << 8) & 0xff00);
+}
+
+static int name_cmp(const void *a, const void *b) {
+    const pack_name *x = a;
+    const pack_name *y = b;
+    return strcmp(x->name, y->name);
+}
+
+static pack *bad_pack(char *filename, pack *p) {
+    fprintf(stderr, "%s: bad sketch pack\n", filename);
+    pack_close(p);
+    return 0;
+}
+
+/* Map the pack in filename.  The shingleprints stay in
+   the mapping, so pack_close() frees them all at once.
+   Returns a null pointer after complaining on failure. */
+pack *pack_open(char *filename) {
+    pack *p;
+    struct pack_header *h;
+    struct pack_doc *docs;
+    char *names;
+    struct stat st;
+    int swap;
+    int fd, i;
+    fd = open(filename, O_RDONLY);
+    if (fd == -1) {
+	perror(filename);
+	return 0;
+    }
+    if (fstat(fd, &st) == -1) {
+	perror(filename);
+	close(fd);
+	return 0;
+    }
+    p = malloc(sizeof *p);
+    assert(p);
+    memset(p, 0, sizeof *p);
+    if (st.st_size < sizeof *h) {
+	close(fd);
+	return bad_pack(filename, p);
+    }
+    p->size = st.st_size;
+    /* private and writable, so a foreign pack
+       can be swapped in place */
+    p->map = mmap(0, p->size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (p->map == MAP_FAILED) {
+	p->map = 0;
+	perror(filename);
+	pack_close(p);
+	return 0;
+    }
+    h = p->map;
+    if (memcmp(h->magic, PACK_MAGIC, sizeof PACK_MAGIC) != 0)
+	return bad_pack(filename, p);
+    swap = h->order != PACK_ORDER;
+    if (swap) {
+	if (swap32(h->order) != PACK_ORDER)
+	    return bad_pack(filename, p);
+	h->order = PACK_ORDER;
+	h->version = swap32(h->version);
+	h->ndoc = swap32(h->ndoc);
+	h->docs = swap32(h->docs);
+	h->names = swap32(h->names);
+	h->nnames = swap32(h->nnames);
+    }
+    if (h->version != PACK_VERSION ||
+	h->docs > p->size ||
+	h->ndoc > (p->size - h->docs) / sizeof *docs ||
+	h->names > p->size ||
+	h->nnames > p->size - h->names ||
+	(h->nnames > 0 && ((char *)p->map)[h->names + h->nnames - 1]))
+	return bad_pack(filename, p);
+    docs = (struct pack_doc *) ((char *)p->map + h->docs);
+    names = (char *)p->map + h->names;
+    p->ndoc = h->ndoc;
+    p->name = malloc(p->ndoc * sizeof p->name[0]);
+    p->doc = malloc(p->ndoc * sizeof p->doc[0]);
+    p->byname = malloc(p->ndoc * sizeof p->byname[0]);
+    assert(p->ndoc == 0 || (p->name && p->doc && p->byname));
+    for (i = 0; i < p->ndoc; i++) {
+	struct pack_doc *d = &docs[i];
+	unsigned long start;
+	size_t used;
+	if (swap) {
+	    d->version = swap16(d->version);
+	    d->nshingle = swap16(d->nshingle);
+	    d->nfeature = swap32(d->nfeature);
+	    d->name = swap32(d->name);
+	    d->feature = swap32(d->feature);
+	}
+	start = (unsigned long) d->feature * LINE;
+	if (!version_family(d->version) ||
+	    d->name >= h->nnames ||
+	    start > p->size)
+	    return bad_pack(filename, p);
+	p->name[i] = names + d->name;
+	p->doc[i].family = d->version & FILE_KIND;
+	p->doc[i].nshingle = d->nshingle;
+	p->doc[i].nfeature = d->nfeature;
+	p->doc[i].feature = 0;
+	p->doc[i].coded = 0;
+	p->doc[i].nbits = 0;
+	p->byname[i].name = p->name[i];
+	p->byname[i].doc = i;
+	if (d->version & FILE_DELTA) {
+	    /* bytes need no swapping, but must be checked */
+	    p->doc[i].coded = (unsigned char *)p->map + start;
+	    if (d->nfeature > 0x7fffffff ||
+		!delta_check(p->doc[i].coded, p->size - start,
+			      d->nfeature, &used) ||
+		p->size - start - used < DELTA_SLACK)
+		return bad_pack(filename, p);
+	    continue;
+	}
+	if (d->nfeature > (p->size - start) / sizeof(unsigned) ||
+	    ((d->version & FILE_BITSIG) &&
+	     (d->nfeature < 1 || d->nfeature > SIG_MAXBITS / 32)))
+	    return bad_pack(filename, p);
+	p->doc[i].feature = (unsigned *) ((char *)p->map + start);
+	if (swap) {
+	    unsigned j;
+	    for (j = 0; j < d->nfeature; j++)
+		p->doc[i].feature[j] = swap32(p->doc[i].feature[j]);
+	}
+	if (d->version & FILE_BITSIG)
+	    p->doc[i].nbits = 32 * d->nfeature;
+	else if (!(d->version & FILE_ASCENDING)) {
+	    reverse_features(p->doc[i].feature, d->nfeature);
+	    d->version |= FILE_ASCENDING;
+	}
+    }
+    qsort(p->byname, p->ndoc, sizeof p->byname[0], name_cmp);
+    return p;
+}
+
+/* the shingleprint named name, or null */
+hashinfo *pack_find(pack *p, char *name) {
+    pack_name key, *found;
+    key.name = name;
+    found = bsearch(&key, p->byname, p->ndoc,
+		    sizeof p->byname[0], name_cmp);
+    if (!found)
+	return 0;
+    return &p->doc[found->doc];
+}
+
+void pack_close(pack *p) {
+    if (p->map)
+	munmap(p->map, p->size);
+    free(p->name);
+    free(p->doc);
+    free(p->byname);
+    free(p);
+}
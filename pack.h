@@ -0,0 +1,28 @@
+/*
+ * Copyright © 2005-2009 Bart Massey
+ * ALL RIGHTS RESERVED
+ * [This program is licensed under the "3-clause ('new') BSD License"]
+ * Please see the file COPYING in the source
+ * distribution of this software for license terms.
+ */
+
+/* a document name, for lookup */
+typedef struct pack_name {
+    char *name;
+    int doc;
+} pack_name;
+
+/* an open sketch pack */
+typedef struct pack {
+    void *map;
+    size_t size;
+    int ndoc;
+    char **name;        /* into the map */
+    hashinfo *doc;      /* features or codes point into the map */
+    pack_name *byname;  /* sorted by name */
+} pack;
+
+extern int pack_write(FILE *f, int n, char **names, hashinfo **his);
+extern pack *pack_open(char *filename);
+extern hashinfo *pack_find(pack *p, char *name);
+extern void pack_close(pack *p);
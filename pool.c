@@ -0,0 +1,81 @@
+/*
+ * Copyright © 2005-2009 Bart Massey
+ * ALL RIGHTS RESERVED
+ * [This program is licensed under the "3-clause ('new') BSD License"]
+ * Please see the file COPYING in the source
+ * distribution of this software for license terms.
+ */
+
+/*
+ * Minimal worker pool.  Jobs are numbered 0..njob-1 and
+ * handed out one at a time to whichever worker is free
+ * next, so a slow job holds up only the worker running
+ * it.  Each worker is also told its own number, so that
+ * it can use per-worker state without locking.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <assert.h>
+#include <pthread.h>
+#include "pool.h"
+
+typedef struct pool {
+    pthread_mutex_t lock;
+    int next;
+    int njob;
+    pool_job *job;
+    void *arg;
+} pool;
+
+typedef struct worker {
+    pool *p;
+    int id;
+    pthread_t thread;
+} worker;
+
+static void *work(void *wp) {
+    worker *w = wp;
+    pool *p = w->p;
+    while (1) {
+	int i;
+	pthread_mutex_lock(&p->lock);
+	i = p->next++;
+	pthread_mutex_unlock(&p->lock);
+	if (i >= p->njob)
+	    return 0;
+	p->job(p->arg, i, w->id);
+    }
+}
+
+void pool_run(int nworker, int njob, pool_job *job, void *arg) {
+    pool p;
+    worker *ws;
+    int i;
+    if (nworker > njob)
+	nworker = njob;
+    if (nworker <= 1) {
+	for (i = 0; i < njob; i++)
+	    job(arg, i, 0);
+	return;
+    }
+    pthread_mutex_init(&p.lock, 0);
+    p.next = 0;
+    p.njob = njob;
+    p.job = job;
+    p.arg = arg;
+    ws = malloc(nworker * sizeof *ws);
+    assert(ws);
+    for (i = 0; i < nworker; i++) {
+	ws[i].p = &p;
+	ws[i].id = i;
+	if (pthread_create(&ws[i].thread, 0, work, &ws[i]) != 0) {
+	    perror("pthread_create");
+	    exit(1);
+	}
+    }
+    for (i = 0; i < nworker; i++)
+	pthread_join(ws[i].thread, 0);
+    pthread_mutex_destroy(&p.lock);
+    free(ws);
+}
@@ -0,0 +1,11 @@
+/*
+ * Copyright © 2005-2009 Bart Massey
+ * ALL RIGHTS RESERVED
+ * [This program is licensed under the "3-clause ('new') BSD License"]
+ * Please see the file COPYING in the source
+ * distribution of this software for license terms.
+ */
+
+typedef void pool_job(void *arg, int job, int worker);
+
+extern void pool_run(int nworker, int njob, pool_job *job, void *arg);
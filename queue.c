@@ -0,0 +1,75 @@
+/*
+ * Copyright © 2005-2009 Bart Massey
+ * ALL RIGHTS RESERVED
+ * [This program is licensed under the "3-clause ('new') BSD License"]
+ * Please see the file COPYING in the source
+ * distribution of this software for license terms.
+ */
+
+/*
+ * Bounded queue, for stages of a pipeline in threads of
+ * their own.  A stage putting to a full queue waits for
+ * the next to catch up, so however much input there is,
+ * no more than size items are ever waiting.
+ */
+
+#include <stdlib.h>
+#include <assert.h>
+#include "queue.h"
+
+void queue_init(queue *q, int size) {
+    assert(size > 0);
+    pthread_mutex_init(&q->lock, 0);
+    pthread_cond_init(&q->nonempty, 0);
+    pthread_cond_init(&q->nonfull, 0);
+    q->item = malloc(size * sizeof q->item[0]);
+    assert(q->item);
+    q->size = size;
+    q->head = 0;
+    q->n = 0;
+    q->closed = 0;
+}
+
+/* add item, waiting for room if need be */
+void queue_put(queue *q, void *item) {
+    pthread_mutex_lock(&q->lock);
+    assert(!q->closed);
+    while (q->n == q->size)
+	pthread_cond_wait(&q->nonfull, &q->lock);
+    q->item[(q->head + q->n) % q->size] = item;
+    q->n++;
+    pthread_cond_signal(&q->nonempty);
+    pthread_mutex_unlock(&q->lock);
+}
+
+/* the oldest item, waiting for one if need be, or a
+   null pointer once the queue is closed and empty */
+void *queue_get(queue *q) {
+    void *item = 0;
+    pthread_mutex_lock(&q->lock);
+    while (q->n == 0 && !q->closed)
+	pthread_cond_wait(&q->nonempty, &q->lock);
+    if (q->n > 0) {
+	item = q->item[q->head];
+	q->head = (q->head + 1) % q->size;
+	q->n--;
+	pthread_cond_signal(&q->nonfull);
+    }
+    pthread_mutex_unlock(&q->lock);
+    return item;
+}
+
+/* no more will be put: wake everyone waiting to get */
+void queue_close(queue *q) {
+    pthread_mutex_lock(&q->lock);
+    q->closed = 1;
+    pthread_cond_broadcast(&q->nonempty);
+    pthread_mutex_unlock(&q->lock);
+}
+
+void queue_free(queue *q) {
+    pthread_cond_destroy(&q->nonfull);
+    pthread_cond_destroy(&q->nonempty);
+    pthread_mutex_destroy(&q->lock);
+    free(q->item);
+}
@@ -0,0 +1,25 @@
+/*
+ * Copyright © 2005-2009 Bart Massey
+ * ALL RIGHTS RESERVED
+ * [This program is licensed under the "3-clause ('new') BSD License"]
+ * Please see the file COPYING in the source
+ * distribution of this software for license terms.
+ */
+
+#include <pthread.h>
+
+/* a bounded queue of pointers between threads */
+typedef struct queue {
+    pthread_mutex_t lock;
+    pthread_cond_t nonempty, nonfull;
+    void **item;
+    int size;
+    int head, n;
+    int closed;             /* nothing more will be put */
+} queue;
+
+extern void queue_init(queue *q, int size);
+extern void queue_put(queue *q, void *item);
+extern void *queue_get(queue *q);
+extern void queue_close(queue *q);
+extern void queue_free(queue *q);
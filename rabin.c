@@ -0,0 +1,64 @@
+/*
+ * Copyright © 2005-2009 Bart Massey
+ * ALL RIGHTS RESERVED
+ * [This program is licensed under the "3-clause ('new') BSD License"]
+ * Please see the file COPYING in the source
+ * distribution of this software for license terms.
+ */
+
+/*
+ * Rolling Rabin fingerprint over GF(2), after Broder's
+ * "Some applications of Rabin's fingerprinting method".
+ * A window of nwindow bytes is treated as a polynomial
+ * and reduced modulo a fixed irreducible polynomial of
+ * degree 32, so sliding the window one byte costs two
+ * table lookups regardless of the window size.
+ */
+
+#include "rabin.h"
+
+/* x^32 + the low 32 bits below; irreducible over GF(2) */
+#define POLY 0xdad7dfa3U
+
+void rabin_init(rabin *r, int nwindow) {
+    int t, i;
+    /* t * x^32 mod POLY, for every possible top byte t */
+    for (t = 0; t < 256; t++) {
+	unsigned v = (unsigned)t << 24;
+	for (i = 0; i < 8; i++) {
+	    if (v & 0x80000000U)
+		v = (v << 1) ^ POLY;
+	    else
+		v <<= 1;
+	}
+	r->shift[t] = v;
+    }
+    /* t * x^(8 nwindow) mod POLY: the fingerprint of t
+       followed by nwindow zero bytes */
+    for (t = 0; t < 256; t++) {
+	unsigned fp = RABIN_APPEND(r, 0U, (unsigned)t);
+	for (i = 0; i < nwindow; i++)
+	    fp = RABIN_APPEND(r, fp, 0U);
+	r->out[t] = fp;
+    }
+}
+
+/* the fingerprint of the n bytes at p */
+unsigned rabin_fingerprint(rabin *r, const unsigned char *p, int n) {
+    unsigned fp = 0;
+    int i;
+    for (i = 0; i < n; i++)
+	fp = RABIN_APPEND(r, fp, p[i]);
+    return fp;
+}
+
+/* A Rabin fingerprint of a short window is little more
+   than the window bytes themselves, which would bias the
+   choice of smallest features toward low byte values.
+   Finish with a bijective mixer (the MurmurHash3
+   finalizer) so the retained features are a uniform
+   sample; being a bijection, it adds no collisions. */
+unsigned rabin_mix(unsigned fp) {
+    RABIN_MIX(fp);
+    return fp;
+}
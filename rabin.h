@@ -0,0 +1,30 @@
+/*
+ * Copyright © 2005-2009 Bart Massey
+ * ALL RIGHTS RESERVED
+ * [This program is licensed under the "3-clause ('new') BSD License"]
+ * Please see the file COPYING in the source
+ * distribution of this software for license terms.
+ */
+
+/* tables for a rolling Rabin fingerprint of a fixed-size window */
+typedef struct rabin {
+    unsigned shift[256];  /* reduction of the byte shifted off the top */
+    unsigned out[256];    /* contribution of the byte leaving the window */
+} rabin;
+
+/* append byte ch to fingerprint fp */
+#define RABIN_APPEND(r, fp, ch) \
+    ((((fp) << 8) | (ch)) ^ (r)->shift[(fp) >> 24])
+
+/* append byte chin and drop byte chout, keeping the window size fixed */
+#define RABIN_ROLL(r, fp, chin, chout) \
+    (RABIN_APPEND(r, fp, chin) ^ (r)->out[chout])
+
+/* finish fingerprint h in place; see rabin_mix() */
+#define RABIN_MIX(h) \
+    ((h) ^= (h) >> 16, (h) *= 0x85ebca6bU, (h) ^= (h) >> 13, \
+     (h) *= 0xc2b2ae35U, (h) ^= (h) >> 16)
+
+extern void rabin_init(rabin *r, int nwindow);
+extern unsigned rabin_mix(unsigned fp);
+extern unsigned rabin_fingerprint(rabin *r, const unsigned char *p, int n);
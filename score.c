@@ -0,0 +1,196 @@
+/*
+ * Copyright © 2005-2009 Bart Massey
+ * ALL RIGHTS RESERVED
+ * [This program is licensed under the "3-clause ('new') BSD License"]
+ * Please see the file COPYING in the source
+ * distribution of this software for license terms.
+ */
+
+/*
+ * Comparing shingleprints.  Almost all the work is
+ * counting the features two shingleprints have in common,
+ * which is done a vector block at a time when the CPU
+ * allows.  Coded shingleprints are decoded first, or
+ * if they are big a feature at a time as they are
+ * merged; the count is the same either way.
+ * Signatures are compared bit for bit instead.
+ */
+
+#include "sketch.h"
+#include "simd.h"
+#include "score.h"
+
+/* bytes of shingleprints to keep in cache at once */
+#define TILE_BYTES (128 * 1024)
+/* most features of a coded shingleprint to decode onto
+   the stack, for the vector merges, rather than merge
+   as it is decoded */
+#define DECODE_MAX 1024
+
+/* Count the values common to a[0 .. na - 1] and
+   b[0 .. nb - 1], both increasing.  Whether a or b
+   steps next is unpredictable, so both steps are
+   computed rather than branched on. */
+int intersect_scalar(const unsigned *a, int na,
+		     const unsigned *b, int nb) {
+    int i = 0, j = 0;
+    int count = 0;
+    while (i < na && j < nb) {
+	unsigned x = a[i];
+	unsigned y = b[j];
+	count += x == y;
+	i += x <= y;
+	j += y <= x;
+    }
+    return count;
+}
+
+/* the same, with the vector kernels if there are any */
+int intersect_count(const unsigned *a, int na,
+		    const unsigned *b, int nb) {
+    int i, j, count;
+    if (simd_avx2)
+	count = intersect_avx2(a, na, b, nb, &i, &j);
+    else if (simd_sse42)
+	count = intersect_sse42(a, na, b, nb, &i, &j);
+    else
+	return intersect_scalar(a, na, b, nb);
+    return count + intersect_scalar(a + i, na - i, b + j, nb - j);
+}
+
+/* a place in the features of a shingleprint, plain or
+   coded */
+struct cursor {
+    const unsigned *f;        /* plain */
+    const unsigned char *c;   /* or the coded differences */
+    unsigned long bit;        /* of the next of them */
+    int width;
+    unsigned mask;
+    unsigned v;               /* the feature here */
+};
+
+static void cursor_start(struct cursor *k, hashinfo *hi) {
+    k->f = hi->feature;
+    k->c = 0;
+    k->bit = 0;
+    k->v = 0;
+    if (hi->coded) {
+	k->c = hi->coded + 1;
+	k->width = hi->coded[0];
+	k->mask = k->width == 32 ? 0xffffffffU : (1U << k->width) - 1;
+    }
+}
+
+/* step cursor k to the next feature */
+#define NEXT_FEATURE(k) do { \
+	if ((k).c) { \
+	    (k).v += DELTA_BITS((k).c, (k).bit, (k).mask); \
+	    (k).bit += (k).width; \
+	} else { \
+	    (k).v = *(k).f++; \
+	} \
+    } while (0)
+
+/* Count the features common to hi1 and hi2, either or
+   both of them coded, without decoding them first. */
+static int intersect_coded(hashinfo *hi1, hashinfo *hi2) {
+    struct cursor x, y;
+    int n1 = hi1->nfeature;
+    int n2 = hi2->nfeature;
+    int count = 0;
+    if (n1 == 0 || n2 == 0)
+	return 0;
+    cursor_start(&x, hi1);
+    cursor_start(&y, hi2);
+    NEXT_FEATURE(x);
+    NEXT_FEATURE(y);
+    while (1) {
+	if (x.v < y.v) {
+	    if (--n1 == 0)
+		break;
+	    NEXT_FEATURE(x);
+	} else if (y.v < x.v) {
+	    if (--n2 == 0)
+		break;
+	    NEXT_FEATURE(y);
+	} else {
+	    count++;
+	    if (--n1 == 0 || --n2 == 0)
+		break;
+	    NEXT_FEATURE(x);
+	    NEXT_FEATURE(y);
+	}
+    }
+    return count;
+}
+
+/* the number of bits in which the signatures hi1 and
+   hi2, of the same size, differ */
+int sig_distance(hashinfo *hi1, hashinfo *hi2) {
+    int d = 0;
+    int i;
+    for (i = 0; i < hi1->nfeature; i++)
+	d += __builtin_popcount(hi1->feature[i] ^ hi2->feature[i]);
+    return d;
+}
+
+/* the fraction of bits that two signatures of nbits bits
+   a distance d apart agree in */
+double sig_score(int d, int nbits) {
+    return 1.0 - (double) d / nbits;
+}
+
+/* The score of shingleprints of n1 and n2 features with
+   matchcount in common: the size of the intersection of
+   the feature sets over the size of their union, where
+   the smaller set bounds the size of both. */
+double overlap_score(int matchcount, int n1, int n2) {
+    int count = n1 < n2 ? n1 : n2;
+    double intersectsize = matchcount;
+    double unionsize = 2 * count - matchcount;
+    return intersectsize / unionsize;
+}
+
+/* The overlap score of two shingleprints.  Signatures
+   score the fraction of their bits that agree, and
+   nothing against anything of another size. */
+double score(hashinfo *hi1, hashinfo *hi2) {
+    int matchcount;
+    if (hi1->nbits || hi2->nbits) {
+	if (hi1->nbits != hi2->nbits)
+	    return 0;
+	return sig_score(sig_distance(hi1, hi2), hi1->nbits);
+    }
+    if (!hi1->coded && !hi2->coded) {
+	matchcount = intersect_count(hi1->feature, hi1->nfeature,
+				     hi2->feature, hi2->nfeature);
+    } else if (hi1->nfeature <= DECODE_MAX && hi2->nfeature <= DECODE_MAX) {
+	unsigned buf1[DECODE_MAX], buf2[DECODE_MAX];
+	matchcount = intersect_count(hash_features(hi1, buf1), hi1->nfeature,
+				     hash_features(hi2, buf2), hi2->nfeature);
+    } else {
+	matchcount = intersect_coded(hi1, hi2);
+    }
+    return overlap_score(matchcount, hi1->nfeature, hi2->nfeature);
+}
+
+/* how many shingleprints of nfeature features
+   make a tile that stays in cache */
+int score_tile_size(int nfeature) {
+    int n = TILE_BYTES / (nfeature * sizeof(unsigned) + 1);
+    return n > 0 ? n : 1;
+}
+
+/* Score hi against each of tile[0 .. ntile - 1], leaving
+   the results in scores; a null hash scores -1.  Scoring
+   many shingleprints against the same tile, one after
+   another, reads the tile from cache rather than memory. */
+void score_tile(hashinfo *hi, hashinfo **tile, int ntile,
+		double *scores) {
+    int i;
+    for (i = 0; i < ntile; i++)
+	if (hi && tile[i])
+	    scores[i] = score(hi, tile[i]);
+	else
+	    scores[i] = -1;
+}
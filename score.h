@@ -0,0 +1,19 @@
+/*
+ * Copyright © 2005-2009 Bart Massey
+ * ALL RIGHTS RESERVED
+ * [This program is licensed under the "3-clause ('new') BSD License"]
+ * Please see the file COPYING in the source
+ * distribution of this software for license terms.
+ */
+
+extern int intersect_scalar(const unsigned *a, int na,
+			    const unsigned *b, int nb);
+extern int intersect_count(const unsigned *a, int na,
+			   const unsigned *b, int nb);
+extern int sig_distance(hashinfo *hi1, hashinfo *hi2);
+extern double sig_score(int d, int nbits);
+extern double overlap_score(int matchcount, int n1, int n2);
+extern double score(hashinfo *hi1, hashinfo *hi2);
+extern int score_tile_size(int nfeature);
+extern void score_tile(hashinfo *hi, hashinfo **tile, int ntile,
+		       double *scores);
@@ -0,0 +1,452 @@
+/*
+ * Copyright © 2005-2009 Bart Massey
+ * ALL RIGHTS RESERVED
+ * [This program is licensed under the "3-clause ('new') BSD License"]
+ * Please see the file COPYING in the source
+ * distribution of this software for license terms.
+ */
+
+/*
+ * Sketch server: keep a corpus of shingleprints in memory
+ * and answer requests for it over a Unix domain socket,
+ * so that a lookup costs a round trip rather than a
+ * process start and a read of every hash file.  Each
+ * connection gets its own thread and hashing context, up
+ * to MAX_CONNECTIONS at once, since each may buffer a
+ * frame of up to FRAME_MAX; later ones wait to be
+ * accepted.  Queries share the corpus under a read lock; adding a
+ * sketch takes the write lock.
+ */
+
+#define _XOPEN_SOURCE 600
+#include <assert.h>
+#include <errno.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include "sketch.h"
+#include "score.h"
+#include "match.h"
+#include "frame.h"
+#include "serve.h"
+
+/* the sketches being served, findable by name */
+static struct corpus {
+    pthread_rwlock_t lock;
+    int n, nalloc;
+    char **name;
+    hashinfo **his;
+    char *owned;        /* is his[i] ours to free? */
+    int *slot;          /* index by name: -1 or a sketch */
+    int nslot;          /* a power of two */
+} corpus;
+
+#define MAX_CONNECTIONS 16
+
+/* connections being answered */
+static struct {
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    int n;
+} active = {PTHREAD_MUTEX_INITIALIZER, PTHREAD_COND_INITIALIZER, 0};
+
+/* shingleprint parameters for hash requests */
+static int serve_nshingle, serve_nfeature, serve_family, serve_nbits;
+/* code hashes made and added? */
+static int serve_compress;
+
+/* FNV-1a */
+static unsigned name_hash(const char *name) {
+    unsigned h = 2166136261U;
+    while (*name)
+	h = (h ^ (unsigned char) *name++) * 16777619U;
+    return h;
+}
+
+/* the slot that has name, or the empty slot it would go in */
+static int find_slot(const char *name) {
+    int s = name_hash(name) & (corpus.nslot - 1);
+    while (corpus.slot[s] != -1 && strcmp(corpus.name[corpus.slot[s]], name))
+	s = (s + 1) & (corpus.nslot - 1);
+    return s;
+}
+
+static void grow_slots(void) {
+    int i;
+    free(corpus.slot);
+    corpus.nslot *= 2;
+    corpus.slot = malloc(corpus.nslot * sizeof corpus.slot[0]);
+    assert(corpus.slot);
+    for (i = 0; i < corpus.nslot; i++)
+	corpus.slot[i] = -1;
+    for (i = 0; i < corpus.n; i++)
+	corpus.slot[find_slot(corpus.name[i])] = i;
+}
+
+/* Keep hi under name, in place of any sketch already
+   there, whose name is kept.  The caller must hold the
+   write lock. */
+static void corpus_add(char *name, hashinfo *hi, int owned) {
+    int s = find_slot(name);
+    int i = corpus.slot[s];
+    if (i != -1) {
+	if (corpus.owned[i])
+	    free_hashinfo(corpus.his[i]);
+	corpus.his[i] = hi;
+	corpus.owned[i] = owned;
+	return;
+    }
+    if (corpus.n == corpus.nalloc) {
+	corpus.nalloc *= 2;
+	corpus.name = realloc(corpus.name, corpus.nalloc * sizeof corpus.name[0]);
+	corpus.his = realloc(corpus.his, corpus.nalloc * sizeof corpus.his[0]);
+	corpus.owned = realloc(corpus.owned, corpus.nalloc);
+	assert(corpus.name && corpus.his && corpus.owned);
+    }
+    i = corpus.n++;
+    corpus.name[i] = name;
+    corpus.his[i] = hi;
+    corpus.owned[i] = owned;
+    corpus.slot[s] = i;
+    if (2 * corpus.n > corpus.nslot)
+	grow_slots();
+}
+
+/* the sketch called name, or a null pointer */
+static hashinfo *corpus_find(const char *name) {
+    int i = corpus.slot[find_slot(name)];
+    return i == -1 ? 0 : corpus.his[i];
+}
+
+/* a reply being built */
+struct reply {
+    int type;
+    char *buf;
+    size_t n, nalloc;
+};
+
+static char *reply_space(struct reply *r, size_t n) {
+    if (r->n + n > r->nalloc) {
+	while (r->n + n > r->nalloc)
+	    r->nalloc *= 2;
+	r->buf = realloc(r->buf, r->nalloc);
+	assert(r->buf);
+    }
+    r->n += n;
+    return r->buf + r->n - n;
+}
+
+static void reply_error(struct reply *r, char *msg) {
+    size_t n = strlen(msg);
+    r->type = FRAME_ERROR;
+    r->n = 0;
+    memcpy(reply_space(r, n), msg, n);
+}
+
+static void reply_score(struct reply *r, double s, char *name) {
+    char *p = reply_space(r, SCORE_CHARS + 1);
+    format_score(p, 0, s);
+    p[SCORE_CHARS] = name ? ' ' : '\n';
+    if (name) {
+	size_t n = strlen(name);
+	p = reply_space(r, n + 1);
+	memcpy(p, name, n);
+	p[n] = '\n';
+    }
+}
+
+/* the NUL-terminated name at the start of the n bytes
+   of buf, or a null pointer */
+static char *take_name(unsigned char *buf, size_t n) {
+    if (!memchr(buf, '\0', n))
+	return 0;
+    return (char *) buf;
+}
+
+static void do_hash(simhash_ctx *ctx, unsigned char *buf, size_t n,
+		    struct reply *r) {
+    hashinfo *hi;
+    simhash_reset(ctx);
+    simhash_update(ctx, buf, n);
+    hi = simhash_end(ctx);
+    if (!hi) {
+	reply_error(r, "not hashable");
+	return;
+    }
+    if (serve_compress)
+	hash_encode_coded(hi, (unsigned char *)
+			  reply_space(r, hash_coded_size(hi)));
+    else
+	hash_encode(hi, (unsigned char *) reply_space(r, hash_size(hi)));
+}
+
+static void do_add(unsigned char *buf, size_t n, struct reply *r) {
+    char *name = take_name(buf, n);
+    size_t len;
+    hashinfo *hi;
+    if (!name) {
+	reply_error(r, "no name");
+	return;
+    }
+    len = strlen(name) + 1;
+    hi = hash_decode(buf + len, n - len);
+    if (!hi) {
+	reply_error(r, "bad hash");
+	return;
+    }
+    /* the corpus is all of the server's own kind */
+    if (hi->family != serve_family) {
+	reply_error(r, "hash family mismatch");
+	free_hashinfo(hi);
+	return;
+    }
+    if (hi->nshingle != serve_nshingle) {
+	reply_error(r, "shingle size mismatch");
+	free_hashinfo(hi);
+	return;
+    }
+    if (hi->nbits != serve_nbits) {
+	reply_error(r, "signature size mismatch");
+	free_hashinfo(hi);
+	return;
+    }
+    if (serve_compress)
+	hash_compress(hi);
+    pthread_rwlock_wrlock(&corpus.lock);
+    if (!corpus_find(name)) {
+	char *copy = malloc(len);
+	assert(copy);
+	name = memcpy(copy, name, len);
+    }
+    corpus_add(name, hi, 1);
+    pthread_rwlock_unlock(&corpus.lock);
+}
+
+static void do_query(unsigned char *buf, size_t n, struct reply *r) {
+    struct top t;
+    hashinfo *hi;
+    unsigned ntop;
+    int i;
+    if (n < 4) {
+	reply_error(r, "no count");
+	return;
+    }
+    ntop = ((unsigned) buf[0] << 24) | (buf[1] << 16) | (buf[2] << 8) | buf[3];
+    if (ntop < 1) {
+	reply_error(r, "bad count");
+	return;
+    }
+    hi = hash_decode(buf + 4, n - 4);
+    if (!hi) {
+	reply_error(r, "bad hash");
+	return;
+    }
+    /* it is scored against everything: decode it once */
+    hash_expand(hi);
+    pthread_rwlock_rdlock(&corpus.lock);
+    if (ntop > corpus.n)
+	ntop = corpus.n;
+    if (ntop > 0) {
+	top_init(&t, 1, ntop);
+	for (i = 0; i < corpus.n; i++) {
+	    hashinfo *c = corpus.his[i];
+	    if (c->family == hi->family && c->nshingle == hi->nshingle &&
+		c->nbits == hi->nbits)
+		top_offer(&t, 0, i, score(hi, c));
+	}
+	for (i = 0; i < t.n[0]; i++)
+	    reply_score(r, t.best[i].score, corpus.name[t.best[i].hash]);
+	top_free(&t);
+    }
+    pthread_rwlock_unlock(&corpus.lock);
+    free_hashinfo(hi);
+}
+
+static void do_compare(unsigned char *buf, size_t n, struct reply *r) {
+    char *name1 = take_name(buf, n);
+    char *name2;
+    size_t len;
+    hashinfo *hi1, *hi2;
+    if (!name1) {
+	reply_error(r, "no name");
+	return;
+    }
+    len = strlen(name1) + 1;
+    name2 = take_name(buf + len, n - len);
+    if (!name2) {
+	reply_error(r, "no second name");
+	return;
+    }
+    pthread_rwlock_rdlock(&corpus.lock);
+    hi1 = corpus_find(name1);
+    hi2 = corpus_find(name2);
+    if (!hi1 || !hi2)
+	reply_error(r, "no such name");
+    else if (hi1->family != hi2->family)
+	reply_error(r, "hash family mismatch");
+    else if (hi1->nshingle != hi2->nshingle)
+	reply_error(r, "shingle size mismatch");
+    else if (hi1->nbits != hi2->nbits)
+	reply_error(r, "signature size mismatch");
+    else
+	reply_score(r, score(hi1, hi2), 0);
+    pthread_rwlock_unlock(&corpus.lock);
+}
+
+/* answer requests on the connection until it closes */
+static void *connection(void *arg) {
+    int fd = *(int *) arg;
+    simhash_ctx ctx;
+    struct reply r;
+    unsigned char *buf = 0;
+    size_t n, nalloc = 0;
+    int op;
+    free(arg);
+    simhash_init(&ctx, serve_nshingle, serve_nfeature, serve_family);
+    if (serve_nbits)
+	simhash_bitsig(&ctx, serve_nbits);
+    r.nalloc = 4096;
+    r.buf = malloc(r.nalloc);
+    assert(r.buf);
+    while (frame_read(fd, &op, &buf, &n, &nalloc) == 1) {
+	r.type = FRAME_OK;
+	r.n = 0;
+	switch (op) {
+	case OP_HASH:
+	    do_hash(&ctx, buf, n, &r);
+	    break;
+	case OP_ADD:
+	    do_add(buf, n, &r);
+	    break;
+	case OP_QUERY:
+	    do_query(buf, n, &r);
+	    break;
+	case OP_COMPARE:
+	    do_compare(buf, n, &r);
+	    break;
+	default:
+	    reply_error(&r, "unknown request");
+	}
+	if (frame_write(fd, r.type, r.buf, r.n) == -1)
+	    break;
+    }
+    close(fd);
+    free(buf);
+    free(r.buf);
+    simhash_free(&ctx);
+    pthread_mutex_lock(&active.lock);
+    active.n--;
+    pthread_cond_signal(&active.cond);
+    pthread_mutex_unlock(&active.lock);
+    return 0;
+}
+
+/* Might a server be answering on the socket at addr?
+   Only a refused connection says no. */
+static int answered(struct sockaddr_un *addr) {
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    int r;
+    if (fd == -1)
+	return 0;
+    r = connect(fd, (struct sockaddr *) addr, sizeof *addr);
+    close(fd);
+    return r == 0 || errno != ECONNREFUSED;
+}
+
+/* Serve the n sketches his, called names, on the socket
+   sockname, hashing with the given parameters (making
+   signatures of nbits bits if it is nonzero), and
+   coding the hashes made and added if compress is set.
+   Null sketches are skipped.  The sketches and names are
+   the caller's, and must outlive the server, which
+   runs until killed. */
+void serve(char *sockname, int n, char **names, hashinfo **his,
+	   int nshingle, int nfeature, int family, int nbits,
+	   int compress) {
+    struct sockaddr_un addr;
+    struct stat st;
+    pthread_attr_t attr;
+    int sock;
+    int i;
+    serve_nshingle = nshingle;
+    serve_nfeature = nfeature;
+    serve_family = family;
+    serve_nbits = nbits;
+    serve_compress = compress;
+    pthread_rwlock_init(&corpus.lock, 0);
+    corpus.nalloc = 64;
+    corpus.name = malloc(corpus.nalloc * sizeof corpus.name[0]);
+    corpus.his = malloc(corpus.nalloc * sizeof corpus.his[0]);
+    corpus.owned = malloc(corpus.nalloc);
+    corpus.nslot = 64;
+    corpus.slot = malloc(corpus.nslot * sizeof corpus.slot[0]);
+    assert(corpus.name && corpus.his && corpus.owned && corpus.slot);
+    for (i = 0; i < corpus.nslot; i++)
+	corpus.slot[i] = -1;
+    for (i = 0; i < n; i++)
+	if (his[i])
+	    corpus_add(names[i], his[i], 0);
+    if (strlen(sockname) >= sizeof addr.sun_path) {
+	fprintf(stderr, "%s: socket name too long\n", sockname);
+	exit(1);
+    }
+    memset(&addr, 0, sizeof addr);
+    addr.sun_family = AF_UNIX;
+    strcpy(addr.sun_path, sockname);
+    /* a socket left by an earlier server is in the way,
+       but one still being served is not ours to take */
+    if (stat(sockname, &st) == 0 && S_ISSOCK(st.st_mode)) {
+	if (answered(&addr)) {
+	    fprintf(stderr, "%s: already being served\n", sockname);
+	    exit(1);
+	}
+	unlink(sockname);
+    }
+    sock = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (sock == -1 ||
+	bind(sock, (struct sockaddr *) &addr, sizeof addr) == -1 ||
+	listen(sock, SOMAXCONN) == -1) {
+	perror(sockname);
+	exit(1);
+    }
+    /* a client going away is not our problem */
+    signal(SIGPIPE, SIG_IGN);
+    pthread_attr_init(&attr);
+    pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+    while (1) {
+	pthread_t tid;
+	int *fd;
+	pthread_mutex_lock(&active.lock);
+	while (active.n >= MAX_CONNECTIONS)
+	    pthread_cond_wait(&active.cond, &active.lock);
+	pthread_mutex_unlock(&active.lock);
+	fd = malloc(sizeof *fd);
+	assert(fd);
+	*fd = accept(sock, 0, 0);
+	if (*fd == -1) {
+	    free(fd);
+	    if (errno == EINTR || errno == ECONNABORTED)
+		continue;
+	    perror("accept");
+	    exit(1);
+	}
+	pthread_mutex_lock(&active.lock);
+	active.n++;
+	pthread_mutex_unlock(&active.lock);
+	if (pthread_create(&tid, &attr, connection, fd) != 0) {
+	    fprintf(stderr, "simhash: can't start connection thread\n");
+	    close(*fd);
+	    free(fd);
+	    pthread_mutex_lock(&active.lock);
+	    active.n--;
+	    pthread_mutex_unlock(&active.lock);
+	}
+    }
+}
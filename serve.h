@@ -0,0 +1,11 @@
+/*
+ * Copyright © 2005-2009 Bart Massey
+ * ALL RIGHTS RESERVED
+ * [This program is licensed under the "3-clause ('new') BSD License"]
+ * Please see the file COPYING in the source
+ * distribution of this software for license terms.
+ */
+
+extern void serve(char *sockname, int n, char **names, hashinfo **his,
+		  int nshingle, int nfeature, int family, int nbits,
+		  int compress);
@@ -0,0 +1,271 @@
+/*
+ * Copyright © 2005-2009 Bart Massey
+ * ALL RIGHTS RESERVED
+ * [This program is licensed under the "3-clause ('new') BSD License"]
+ * Please see the file COPYING in the source
+ * distribution of this software for license terms.
+ */
+
+/*
+ * Vector kernels for x86, chosen at runtime.  Everything
+ * here has a plain C equivalent elsewhere that gives
+ * exactly the same answers; the scalar versions are what
+ * is used on other CPUs and compilers.
+ */
+
+#include <stdlib.h>
+#include "rabin.h"
+#include "crc32c.h"
+#include "simd.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define HAVE_X86
+#include <immintrin.h>
+#endif
+
+int simd_avx2 = 0;
+int simd_sse42 = 0;
+
+/* look for vector units, unless told not to */
+void simd_init(int enable) {
+#ifdef HAVE_X86
+    __builtin_cpu_init();
+    simd_avx2 = enable && __builtin_cpu_supports("avx2");
+    simd_sse42 = enable && __builtin_cpu_supports("sse4.2");
+#else
+    simd_avx2 = 0;
+    simd_sse42 = 0;
+#endif
+}
+
+#ifdef HAVE_X86
+
+/*
+ * The Rabin fingerprint is one long chain of dependent
+ * table lookups, so it can't be vectorized along the
+ * input.  Instead the block is cut into eight pieces
+ * fingerprinted side by side, one per lane.  The lanes'
+ * fingerprints are then mixed and compared against limit
+ * eight at a time.  The smallest features don't depend
+ * on the order shingles are seen in, so this gives the
+ * same shingleprint as walking the input in order.
+ *
+ * Fingerprints the npos shingles ending at p[0] ..
+ * p[npos - 1], and copies those less than limit to out.
+ * p[-nwindow - 3] must be readable.  Returns the number
+ * of fingerprints copied.  npos must be a multiple of 8.
+ */
+__attribute__((target("avx2")))
+size_t rabin_block_avx2(rabin *r, const unsigned char *p,
+			size_t npos, int nwindow,
+			unsigned limit, unsigned *out) {
+    size_t lanelen = npos / 8;
+    size_t i;
+    size_t nout = 0;
+    int lane;
+    unsigned start[8];
+    __m256i fp, base, vlimit;
+    const __m256i sign = _mm256_set1_epi32(0x80000000);
+    const __m256i m1 = _mm256_set1_epi32(0x85ebca6b);
+    const __m256i m2 = _mm256_set1_epi32(0xc2b2ae35);
+    /* each lane starts with the window before its first shingle */
+    for (lane = 0; lane < 8; lane++)
+	start[lane] = rabin_fingerprint(r, p + lane * lanelen - nwindow,
+					nwindow);
+    fp = _mm256_loadu_si256((__m256i *)start);
+    for (lane = 0; lane < 8; lane++)
+	start[lane] = lane * lanelen;
+    base = _mm256_loadu_si256((__m256i *)start);
+    vlimit = _mm256_set1_epi32(limit ^ 0x80000000);
+    for (i = 0; i < lanelen; i++) {
+	__m256i pos = _mm256_add_epi32(base, _mm256_set1_epi32(i));
+	/* the bytes entering and leaving are the tops of the
+	   words ending there; masking the bottoms of the
+	   words starting there is half the speed */
+	__m256i in = _mm256_srli_epi32(
+	    _mm256_i32gather_epi32((const int *)(p - 3), pos, 1), 24);
+	__m256i gone = _mm256_srli_epi32(
+	    _mm256_i32gather_epi32((const int *)(p - nwindow - 3), pos, 1),
+	    24);
+	__m256i top = _mm256_i32gather_epi32((const int *)r->shift,
+					     _mm256_srli_epi32(fp, 24), 4);
+	__m256i old = _mm256_i32gather_epi32((const int *)r->out, gone, 4);
+	__m256i crc;
+	int mask;
+	fp = _mm256_or_si256(_mm256_slli_epi32(fp, 8), in);
+	fp = _mm256_xor_si256(_mm256_xor_si256(fp, top), old);
+	/* RABIN_MIX */
+	crc = _mm256_xor_si256(fp, _mm256_srli_epi32(fp, 16));
+	crc = _mm256_mullo_epi32(crc, m1);
+	crc = _mm256_xor_si256(crc, _mm256_srli_epi32(crc, 13));
+	crc = _mm256_mullo_epi32(crc, m2);
+	crc = _mm256_xor_si256(crc, _mm256_srli_epi32(crc, 16));
+	/* unsigned crc < limit, by way of a signed compare */
+	mask = _mm256_movemask_ps(_mm256_castsi256_ps(
+	    _mm256_cmpgt_epi32(vlimit, _mm256_xor_si256(crc, sign))));
+	if (mask) {
+	    unsigned crcs[8];
+	    _mm256_storeu_si256((__m256i *)crcs, crc);
+	    for (lane = 0; lane < 8; lane++)
+		if (mask & (1 << lane))
+		    out[nout++] = crcs[lane];
+	}
+    }
+    return nout;
+}
+
+/*
+ * Fingerprints the npos shingles ending at p[0] ..
+ * p[npos - 1] with the SSE4.2 crc32 instruction, and
+ * copies those whose mixed fingerprint is less than limit
+ * to out, as for rabin_block_avx2().  The instruction has
+ * a latency of several cycles but can start one every
+ * cycle, so four pieces of the block are run side by side
+ * to keep it busy, and their four fingerprints are mixed
+ * and compared together.  p[-nwindow] must be readable.
+ * npos must be a multiple of 4.
+ */
+__attribute__((target("sse4.2")))
+size_t crc32c_block_sse42(crc32c *c, const unsigned char *p,
+			  size_t npos, int nwindow,
+			  unsigned limit, unsigned *out) {
+    size_t lanelen = npos / 4;
+    size_t i;
+    size_t nout = 0;
+    int lane;
+    const unsigned char *in[4];
+    const unsigned char *gone[4];
+    unsigned crc[4];
+    __m128i vlimit;
+    const __m128i sign = _mm_set1_epi32(0x80000000);
+    const __m128i m1 = _mm_set1_epi32(0x85ebca6b);
+    const __m128i m2 = _mm_set1_epi32(0xc2b2ae35);
+    for (lane = 0; lane < 4; lane++) {
+	in[lane] = p + lane * lanelen;
+	gone[lane] = in[lane] - nwindow;
+	crc[lane] = crc32c_fingerprint(c, gone[lane], nwindow);
+    }
+    vlimit = _mm_set1_epi32(limit ^ 0x80000000);
+    for (i = 0; i < lanelen; i++) {
+	__m128i v;
+	int mask;
+	for (lane = 0; lane < 4; lane++)
+	    crc[lane] = _mm_crc32_u8(crc[lane], in[lane][i]) ^
+		c->out[gone[lane][i]];
+	v = _mm_loadu_si128((__m128i *)crc);
+	v = _mm_xor_si128(v, _mm_srli_epi32(v, 16));
+	v = _mm_mullo_epi32(v, m1);
+	v = _mm_xor_si128(v, _mm_srli_epi32(v, 13));
+	v = _mm_mullo_epi32(v, m2);
+	v = _mm_xor_si128(v, _mm_srli_epi32(v, 16));
+	mask = _mm_movemask_ps(_mm_castsi128_ps(
+	    _mm_cmpgt_epi32(vlimit, _mm_xor_si128(v, sign))));
+	if (mask) {
+	    unsigned crcs[4];
+	    _mm_storeu_si128((__m128i *)crcs, v);
+	    for (lane = 0; lane < 4; lane++)
+		if (mask & (1 << lane))
+		    out[nout++] = crcs[lane];
+	}
+    }
+    return nout;
+}
+
+/*
+ * Sorted set intersection, a block at a time: every
+ * value of an 8-value block of a is compared with every
+ * value of an 8-value block of b by rotating the b block
+ * through all eight lanes.  Each value occurs at most
+ * once in each set, so the matches are just the lanes of
+ * a that matched anything.  Then whichever block ends
+ * lower is finished with; if they end together, both are.
+ * The choice is made arithmetically, since it's a coin
+ * flip.
+ *
+ * Counts the values common to a[0 .. na - 1] and
+ * b[0 .. nb - 1], both increasing, until one set has
+ * fewer than 8 values left.  Sets *ia and *ib to where
+ * it stopped in each; the caller finishes the count.
+ */
+__attribute__((target("avx2,popcnt")))
+int intersect_avx2(const unsigned *a, int na, const unsigned *b, int nb,
+		   int *ia, int *ib) {
+    const __m256i rot = _mm256_setr_epi32(1, 2, 3, 4, 5, 6, 7, 0);
+    int i = 0, j = 0;
+    int count = 0;
+    while (i + 8 <= na && j + 8 <= nb) {
+	__m256i va = _mm256_loadu_si256((const __m256i *)(a + i));
+	__m256i vb = _mm256_loadu_si256((const __m256i *)(b + j));
+	__m256i m = _mm256_cmpeq_epi32(va, vb);
+	unsigned amax = a[i + 7];
+	unsigned bmax = b[j + 7];
+	int r;
+	for (r = 1; r < 8; r++) {
+	    vb = _mm256_permutevar8x32_epi32(vb, rot);
+	    m = _mm256_or_si256(m, _mm256_cmpeq_epi32(va, vb));
+	}
+	count += __builtin_popcount(_mm256_movemask_ps(_mm256_castsi256_ps(m)));
+	i += (amax <= bmax) << 3;
+	j += (bmax <= amax) << 3;
+    }
+    *ia = i;
+    *ib = j;
+    return count;
+}
+
+/* the same, four values at a time, for intersect_avx2() */
+__attribute__((target("sse4.2,popcnt")))
+int intersect_sse42(const unsigned *a, int na, const unsigned *b, int nb,
+		    int *ia, int *ib) {
+    int i = 0, j = 0;
+    int count = 0;
+    while (i + 4 <= na && j + 4 <= nb) {
+	__m128i va = _mm_loadu_si128((const __m128i *)(a + i));
+	__m128i vb = _mm_loadu_si128((const __m128i *)(b + j));
+	__m128i m = _mm_cmpeq_epi32(va, vb);
+	unsigned amax = a[i + 3];
+	unsigned bmax = b[j + 3];
+	vb = _mm_shuffle_epi32(vb, _MM_SHUFFLE(0, 3, 2, 1));
+	m = _mm_or_si128(m, _mm_cmpeq_epi32(va, vb));
+	vb = _mm_shuffle_epi32(vb, _MM_SHUFFLE(0, 3, 2, 1));
+	m = _mm_or_si128(m, _mm_cmpeq_epi32(va, vb));
+	vb = _mm_shuffle_epi32(vb, _MM_SHUFFLE(0, 3, 2, 1));
+	m = _mm_or_si128(m, _mm_cmpeq_epi32(va, vb));
+	count += __builtin_popcount(_mm_movemask_ps(_mm_castsi128_ps(m)));
+	i += (amax <= bmax) << 2;
+	j += (bmax <= amax) << 2;
+    }
+    *ia = i;
+    *ib = j;
+    return count;
+}
+
+#else
+
+size_t crc32c_block_sse42(crc32c *c, const unsigned char *p,
+			  size_t npos, int nwindow,
+			  unsigned limit, unsigned *out) {
+    abort();
+    /*NOTREACHED*/
+}
+
+size_t rabin_block_avx2(rabin *r, const unsigned char *p,
+			size_t npos, int nwindow,
+			unsigned limit, unsigned *out) {
+    abort();
+    /*NOTREACHED*/
+}
+
+int intersect_avx2(const unsigned *a, int na, const unsigned *b, int nb,
+		   int *ia, int *ib) {
+    abort();
+    /*NOTREACHED*/
+}
+
+int intersect_sse42(const unsigned *a, int na, const unsigned *b, int nb,
+		    int *ia, int *ib) {
+    abort();
+    /*NOTREACHED*/
+}
+
+#endif
@@ -0,0 +1,23 @@
+/*
+ * Copyright © 2005-2009 Bart Massey
+ * ALL RIGHTS RESERVED
+ * [This program is licensed under the "3-clause ('new') BSD License"]
+ * Please see the file COPYING in the source
+ * distribution of this software for license terms.
+ */
+
+/* nonzero if the AVX2 or SSE4.2 kernels may be used */
+extern int simd_avx2;
+extern int simd_sse42;
+
+extern void simd_init(int enable);
+extern size_t rabin_block_avx2(rabin *r, const unsigned char *p,
+			       size_t npos, int nwindow,
+			       unsigned limit, unsigned *out);
+extern size_t crc32c_block_sse42(crc32c *c, const unsigned char *p,
+				 size_t npos, int nwindow,
+				 unsigned limit, unsigned *out);
+extern int intersect_avx2(const unsigned *a, int na,
+			  const unsigned *b, int nb, int *ia, int *ib);
+extern int intersect_sse42(const unsigned *a, int na,
+			   const unsigned *b, int nb, int *ia, int *ib);
@@ -31,31 +31,96 @@
  *   Sequences II: Methods in Communications, Security, and
  *   Computer Science, Springer-Verlag, 1993.
  *   http://athos.rutgers.edu/~muthu/broder.ps
+ *
+ *   Moses S. Charikar
+ *   Similarity estimation techniques from rounding algorithms
+ *   In Proceedings of the 34th Annual ACM Symposium on
+ *   Theory of Computing (STOC'02), pages 380-388, 2002
  */
 
+#define _GNU_SOURCE
+#define _FILE_OFFSET_BITS 64
 #include <stdlib.h>
 #include <sys/param.h>
-#include <netinet/in.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <fcntl.h>
 #include <string.h>
 #include <stdio.h>
+#include <errno.h>
 #include <assert.h>
-#include <math.h>
-#include "crc.h"
-#include "heap.h"
-#include "hash.h"
+#include <pthread.h>
+#include "sketch.h"
+#include "pool.h"
+#include "input.h"
+#include "decomp.h"
+#include "simd.h"
+#include "lsh.h"
+#include "pack.h"
+#include "score.h"
+#include "match.h"
+#include "serve.h"
+#include "cache.h"
+#include "stats.h"
+#include "walk.h"
+#include "index.h"
 
 #include <unistd.h>
-#define _GNU_SOURCE
 #include <getopt.h>
 
 /* size of a shingle in bytes.  should be
    at least 4 to make CRC work */
 int nshingle = 8;
+/* if nonzero, shingle this many words rather than bytes */
+int ntokens = 0;
+/* trees to hash all the files of, and a file of names
+   to hash; either means the files are found as they are
+   hashed, rather than all named at the start */
+char **walk_dirs = 0;
+int nwalk_dir = 0;
+char *files_from = 0;
 int nfeature = 128;
+/* fingerprint family, one of the HASH_ codes in sketch.h */
+int hash_family;
 /* were the defaults changed? */
 int pset = 0;
 /* do a debugging trace? */
 int debug_trace = 0;
+/* use vector kernels if the CPU has them? */
+int use_simd = 1;
+/* in match mode, list only pairs scoring at least
+   threshold, found by LSH with nband bands of nrow rows */
+int lsh = 0;
+double threshold = 0.5;
+int nband = 32;
+int nrow = 3;
+/* in match mode, list instead the groups of files joined
+   by such pairs */
+int cluster = 0;
+/* sketch pack to write with -w, or to read with -c and -m */
+char *packfile = 0;
+/* if positive, compare only this many of the smallest features */
+int compare_k = 0;
+/* in match mode, if positive, list only each file's
+   ntop best neighbours */
+int ntop = 0;
+/* socket to serve sketches on */
+char *sockname = 0;
+/* inverted index to add to, or with a query file to
+   look up its best matches in */
+char *indexfile = 0;
+char *queryfile = 0;
+/* rehash cache file, and should its counts be reported? */
+char *cachefile = 0;
+int show_cache_stats = 0;
+/* report run statistics? */
+int show_stats = 0;
+/* delta code the hashes made, written and kept? */
+int compress = 0;
+/* if nonzero, make signatures of this many bits rather
+   than shingleprints */
+int nbits = 0;
+int sig_bits = 64;
 
 static struct option long_options[] = {
     {"write-hashfile", 0, 0, 'w'},
@@ -64,199 +129,511 @@ static struct option long_options[] = {
     {"shingle-size", 1, 0, 's'},
     {"feature-set-size", 1, 0, 'f'},
     {"debug-trace", 1, 0, 'd'},
+    {"hash", 1, 0, 'H'},
+    {"jobs", 1, 0, 'j'},
+    {"split-size", 1, 0, 'S'},
+    {"no-simd", 0, 0, 'V'},
+    {"threshold", 1, 0, 'T'},
+    {"bands", 1, 0, 'B'},
+    {"rows", 1, 0, 'R'},
+    {"pack", 1, 0, 'P'},
+    {"compare-k", 1, 0, 'K'},
+    {"top", 1, 0, 'N'},
+    {"serve", 1, 0, 'L'},
+    {"cache", 1, 0, 'C'},
+    {"cache-stats", 0, 0, 'A'},
+    {"stats", 0, 0, 'Z'},
+    {"compress", 0, 0, 'Q'},
+    {"mode", 1, 0, 'M'},
+    {"bits", 1, 0, 'G'},
+    {"tokens", 1, 0, 'W'},
+    {"no-decompress", 0, 0, 'X'},
+    {"recursive", 1, 0, 'r'},
+    {"files-from", 1, 0, 'F'},
+    {"index", 1, 0, 'I'},
+    {"query", 1, 0, 'U'},
+    {"cluster", 1, 0, 'Y'},
     {0,0,0,0}
 };
 
-/* HASH FILE VERSION */
-#define FILE_VERSION 0xcb01
-
 /* SUFFIX for hash outputs */
 #define SUFFIX ".sim"
 
-/* if crc is less than top of heap, extract
-   top-of-heap, then insert crc.  don't worry
-   about sign bits---doesn't matter here. */
-static void crc_insert(unsigned crc) {
-    if (debug_trace)
-	fprintf(stderr, ">got %x\n", crc);
-    if(nheap == nfeature && crc >= heap[0])
-	return;
-    if (hash_contains(crc)) {
-	if (debug_trace)
-	    fprintf(stderr, ">dup\n");
-	return;
-    }
-    if(nheap == nfeature) {
-	unsigned m = heap_extract_max();
-	assert(hash_delete(m));
-	if (debug_trace)
-	    fprintf(stderr, ">pop %x\n", m);
-    }
-    if (debug_trace)
-	fprintf(stderr, ">push\n");
-    hash_insert(crc);
-    heap_insert(crc);
-}
+/* number of hashing threads */
+int njobs = 1;
 
-/* return true if the file had enough bytes
-   for at least a single shingle. */
-static int running_crc(FILE *f) {
-    int i;
-    static char *buf = 0;
-    if (buf == 0) {
-	buf = malloc(nshingle);
-	assert(buf);
-    }
-    for (i = 0; i < nshingle; i++) {
-	int ch = fgetc(f);
-	if (ch == EOF) {
-	    fclose(f);
-	    return 0;
-	}
-	buf[i] = ch;
-    }
-    i = 0;
-    while(1) {
-	int ch;
-	crc_insert((unsigned)hash_crc32(buf, i, nshingle));
-	ch = fgetc(f);
-	if (ch == EOF) {
-	    fclose(f);
-	    return 1;
+/* shingleprint contexts, one per hashing thread */
+static simhash_ctx *ctxs;
+
+/* room for the file form of a hash, one per hashing
+   thread, grown as need be */
+static struct outbuf {
+    unsigned char *p;
+    size_t n;
+} *outbufs;
+
+/* hashes of files already hashed, if asked for */
+static cache *rehash_cache;
+
+/* with more than one thread, regular files at least this
+   big are split into ranges that are hashed in parallel */
+off_t split_size = 64 * 1024 * 1024;
+
+/* Hashes come from, and belong to, the context that
+   made them: they are good until it hashes again. */
+
+static hashinfo * hash_file(simhash_ctx *ctx, int fd, char *name) {
+    simhash_reset(ctx);
+    if (input_file(ctx, fd) == -1) {
+	/* a damaged compressed file is just not hashed */
+	if (errno != EBADMSG) {
+	    perror(name);
+	    exit(1);
 	}
-	buf[i] = ch;
-	i = (i + 1) % nshingle;
+	fprintf(stderr, "%s: warning: damaged compressed data\n", name);
+	close(fd);
+	return 0;
     }
-    assert(0);
-    /*NOTREACHED*/
+    close(fd);
+    return simhash_end(ctx);
 }
 
-typedef struct hashinfo {
-    unsigned short nshingle;
-    unsigned int nfeature;
-    unsigned *feature;
-} hashinfo;
-
-static void free_hashinfo(hashinfo *hi) {
-    free(hi->feature);
-    free(hi);
-}
-
-static hashinfo * get_hashinfo() {
-    hashinfo *hi = malloc(sizeof *hi);
-    unsigned *crcs = malloc(nheap * sizeof crcs[0]);
-    int i = 0;
-    assert(hi);
-    assert(crcs);
-    hi->nshingle = nshingle;
-    hi->nfeature = nheap;
-    while (nheap > 0)
-	crcs[i++] = heap_extract_max();
-    hi->feature = crcs;
+
+/* Look for the open file fd in the rehash cache, leaving
+   its hash in ctx's and *hi pointing to it if it is
+   there.  Returns 1 if fd can be cached, with key set up
+   for cache_add().  A compressed file's hash is of what
+   it decompresses to, so the key says whether it was
+   decompressed. */
+static int cache_lookup(simhash_ctx *ctx, int fd, cache_key *key,
+			hashinfo **hi) {
+    int family = hash_family;
+    *hi = 0;
+    if (!rehash_cache || debug_trace)
+	return 0;
+    family |= input_format(fd) << CACHE_FORMAT_SHIFT;
+    if (nbits)
+	family |= FILE_BITSIG;
+    if (!cache_make_key(fd, nshingle, nbits ? nbits : nfeature,
+			family, key))
+	return 0;
+    if (cache_find(rehash_cache, key, &ctx->hash))
+	*hi = &ctx->hash;
+    return 1;
+}
+
+
+/* hash the open file fd, closing it */
+static hashinfo * hash_fd(simhash_ctx *ctx, int fd, char *filename) {
+    hashinfo *hi;
+    cache_key key;
+    int keyed;
+    keyed = cache_lookup(ctx, fd, &key, &hi);
+    if (hi) {
+	close(fd);
+	return hi;
+    }
+    hi = hash_file(ctx, fd, filename);
+    if (keyed && hi)
+	cache_add(rehash_cache, &key, hi);
     return hi;
 }
 
-static hashinfo * hash_file(FILE *f) {
-    heap_reset(nfeature);
-    hash_reset(nfeature);
-    if (!running_crc(f))
+static hashinfo * hash_filename(simhash_ctx *ctx, char *filename) {
+    int fd = open(filename, O_RDONLY);
+    if (fd == -1) {
+	perror(filename);
+	exit(1);
+    }
+    return hash_fd(ctx, fd, filename);
+}
+
+
+/* Words don't stop at the edges of a range, so files
+   shingled by words are always hashed whole, as are
+   compressed files, which can only be read in order. */
+static int splittable(char *filename) {
+    struct stat st;
+    int fd, format;
+    if (njobs <= 1 || ntokens || stat(filename, &st) == -1 ||
+	!S_ISREG(st.st_mode) ||
+	st.st_size < split_size || st.st_size < nshingle)
 	return 0;
-    return get_hashinfo();
+    fd = open(filename, O_RDONLY);
+    if (fd == -1)
+	return 0;
+    format = input_format(fd);
+    close(fd);
+    return format == DECOMP_NONE;
 }
 
+struct split {
+    char *filename;
+    int fd;
+    off_t size;
+    off_t chunk;       /* shingle positions per range */
+};
+
+/* hash the shingles starting in range i into the
+   worker's context */
+static void hash_range(void *arg, int i, int worker) {
+    struct split *sp = arg;
+    off_t start = i * sp->chunk;
+    off_t end = start + sp->chunk + nshingle - 1;
+    if (end > sp->size)
+	end = sp->size;
+    simhash_restart(&ctxs[worker]);
+    if (input_range(&ctxs[worker], sp->fd, start, end) == -1) {
+	perror(sp->filename);
+	exit(1);
+    }
+}
 
-static hashinfo * hash_filename(char *filename) {
-    FILE *f = fopen(filename, "r");
+/* Hash a big file using all the workers: split it into
+   ranges of shingle positions, each range read with the
+   nshingle-1 bytes of overlap its last shingles need,
+   and merge the workers' features at the end. */
+static hashinfo * hash_split(char *filename) {
+    struct split sp;
+    struct stat st;
+    off_t npos;
+    int nrange = 4 * njobs;
     hashinfo *hi;
-    if (!f) {
+    cache_key key;
+    int keyed;
+    int i;
+    sp.filename = filename;
+    sp.fd = open(filename, O_RDONLY);
+    if (sp.fd == -1 || fstat(sp.fd, &st) == -1) {
 	perror(filename);
 	exit(1);
     }
-    hi = hash_file(f);
+    keyed = cache_lookup(&ctxs[0], sp.fd, &key, &hi);
+    if (hi) {
+	close(sp.fd);
+	return hi;
+    }
+    sp.size = st.st_size;
+    npos = sp.size - nshingle + 1;
+    sp.chunk = (npos + nrange - 1) / nrange;
+    nrange = (npos + sp.chunk - 1) / sp.chunk;
+    for (i = 0; i < njobs; i++)
+	simhash_reset(&ctxs[i]);
+    pool_run(njobs, nrange, hash_range, &sp);
+    close(sp.fd);
+    for (i = 1; i < njobs; i++)
+	simhash_merge(&ctxs[0], &ctxs[i]);
+    hi = simhash_end(&ctxs[0]);
+    if (keyed && hi)
+	cache_add(rehash_cache, &key, hi);
     return hi;
 }
 
+/* hi, made by worker's context, is only lent: what is
+   to be kept must be copied */
+typedef void hashed_fn(void *arg, int worker, int i, char *name,
+		       hashinfo *hi);
 
-static void write_hash(hashinfo *hi, FILE *f) {
-    short s = htons(FILE_VERSION);  /* file/CRC version */
+struct batch {
+    char **argv;
+    int *index;          /* which argument each job hashes */
+    hashed_fn *hashed;
+    void *arg;
+};
+
+static void hash_one(void *arg, int job, int worker) {
+    struct batch *b = arg;
+    int i = b->index[job];
+    b->hashed(b->arg, worker, i, b->argv[i],
+	      hash_filename(&ctxs[worker], b->argv[i]));
+}
+
+/* Hash each named file, calling hashed() with its index and
+   hash (null if it couldn't be hashed).  Ordinary files are
+   spread across the workers, so hashed() may be called
+   concurrently.  Big files are then hashed one at a time,
+   each split across all the workers. */
+static void hash_files(int argc, char **argv, hashed_fn *hashed, void *arg) {
+    struct batch b;
+    int nsmall = 0;
+    int nbig = 0;
     int i;
-    fwrite(&s, sizeof(short), 1, f);
-    s = htons(hi->nshingle);
-    fwrite(&s, sizeof(short), 1, f);
-    for(i = 0; i < hi->nfeature; i++) {
-	unsigned hv = htonl(hi->feature[i]);
-	fwrite(&hv, sizeof(unsigned), 1, f);
+    b.argv = argv;
+    b.index = malloc(argc * sizeof *b.index);
+    assert(b.index);
+    b.hashed = hashed;
+    b.arg = arg;
+    /* small files from the front, big from the back */
+    for (i = 0; i < argc; i++) {
+	if (splittable(argv[i]))
+	    b.index[argc - ++nbig] = i;
+	else
+	    b.index[nsmall++] = i;
     }
+    pool_run(njobs, nsmall, hash_one, &b);
+    for (i = argc - 1; i >= nsmall; --i)
+	hashed(arg, 0, b.index[i], argv[b.index[i]],
+	       hash_split(argv[b.index[i]]));
+    free(b.index);
 }
 
-static void write_hashes(int argc, char **argv) {
-    int i;
-    static char nambuf[MAXPATHLEN + 1];
-    for(i = 0; i < argc; i++) {
-	hashinfo *hi = hash_filename(argv[i]);
-	FILE *of;
-	if (hi == 0) {
-	    fprintf(stderr, "%s: warning: not hashed\n", argv[i]);
-	    continue;
-	}
-	strncpy(nambuf, argv[i],
-		MAXPATHLEN - sizeof(SUFFIX));
-	nambuf[MAXPATHLEN - sizeof(SUFFIX)] = '\0';
-	strcat(nambuf, SUFFIX);
-	of = fopen(nambuf, "w");
-	if (!of) {
-	    perror(argv[i]);
-	    exit(1);
+/* the files named, and those to be found by -r and
+   --files-from; hash files found in trees are left out */
+static void walk_setup(walk_sources *src, int argc, char **argv) {
+    src->nname = argc;
+    src->name = argv;
+    src->ndir = nwalk_dir;
+    src->dir = walk_dirs;
+    src->files_from = files_from;
+    src->skip = SUFFIX;
+}
+
+/* With -r or --files-from, replace *argc and *argv with
+   the names of all the files found, named ones included,
+   without hashing them. */
+static void walk_names(int *argc, char ***argv) {
+    walk_sources src;
+    walk *w;
+    walk_file *f;
+    char **names = 0;
+    int nalloc = 0;
+    if (!nwalk_dir && !files_from)
+	return;
+    walk_setup(&src, *argc, *argv);
+    w = walk_start(&src, 1);
+    while ((f = walk_next(w))) {
+	if (f->fd != -1)
+	    close(f->fd);
+	if (f->index >= nalloc) {
+	    nalloc = 2 * nalloc + 1024;
+	    names = realloc(names, nalloc * sizeof names[0]);
+	    assert(names);
 	}
-	write_hash(hi, of);
-	fclose(of);
-	free_hashinfo(hi);
+	names[f->index] = f->name;
+	f->name = 0;
+	walk_done(w, f);
     }
+    *argc = walk_finish(w);
+    if (*argc == -1)
+	exit(1);
+    *argv = names;
 }
 
-/* fills features with the features from f, and returns a
-   pointer to info.  A null pointer is returned on error. */
-static hashinfo *read_hash(FILE *f) {
-    hashinfo *h = malloc(sizeof(hashinfo));
-    short s;
+/* free the names found by walk_names() or keep_hashes() */
+static void free_names(int argc, char **argv) {
     int i;
-    unsigned short version;
-    assert(h);
-    fread(&s, sizeof(short), 1, f);
-    version = ntohs(s);
-    if (version != FILE_VERSION) {
-	fprintf(stderr, "bad file version\n");
-	return 0;
+    if (!nwalk_dir && !files_from)
+	return;
+    for (i = 0; i < argc; i++)
+	free(argv[i]);
+    free(argv);
+}
+
+struct walking {
+    walk *w;
+    hashed_fn *hashed;
+    void *arg;
+};
+
+/* a hashing thread: hash files until there are no more */
+static void hash_walked(void *arg, int job, int worker) {
+    struct walking *wk = arg;
+    walk_file *f;
+    while ((f = walk_next(wk->w))) {
+	hashinfo *hi = 0;
+	if (f->fd != -1)
+	    hi = hash_fd(&ctxs[worker], f->fd, f->name);
+	wk->hashed(wk->arg, worker, f->index, f->name, hi);
+	walk_done(wk->w, f);
     }
-    fread(&s, sizeof(short), 1, f);
-    h->nshingle = ntohs(s);
-    h->nfeature = 16;
-    h->feature = malloc(h->nfeature * sizeof(int));
-    assert(h->feature);
-    i = 0;
-    while(1) {
-	int fe;
-	int nread = fread(&fe, sizeof(int), 1, f);
-	if (nread <= 0) {
-	    if (ferror(f)) {
-		perror("fread");
-		return 0;
-	    }
-	    h->nfeature = i;
-	    h->feature = realloc(h->feature, h->nfeature * sizeof(int));
-	    assert(h->feature);
-	    return h;
-	}
-	if (i >= h->nfeature) {
-	    h->nfeature *= 2;
-	    h->feature = realloc(h->feature, h->nfeature * sizeof(int));
-	    assert(h->feature);
+}
+
+/* Hash the named files and those found by -r and
+   --files-from, calling hashed() with each one's index
+   in the order they were found, name and hash, as
+   hash_files() does.  The files are found, opened and
+   read ahead by stages running in threads of their own,
+   a few files ahead of the hashing threads; files found
+   this way are not split.  Returns the number of files. */
+static int hash_walk(int argc, char **argv, hashed_fn *hashed, void *arg) {
+    walk_sources src;
+    struct walking wk;
+    int n;
+    walk_setup(&src, argc, argv);
+    wk.w = walk_start(&src, 2 * njobs);
+    wk.hashed = hashed;
+    wk.arg = arg;
+    pool_run(njobs, njobs, hash_walked, &wk);
+    n = walk_finish(wk.w);
+    if (n == -1)
+	exit(1);
+    return n;
+}
+
+/* Write the file form of hi to fd, by way of worker's
+   buffer.  Returns -1 with errno set if it can't. */
+static int write_hash(hashinfo *hi, int fd, int worker) {
+    struct outbuf *b = &outbufs[worker];
+    size_t n = compress ? hash_coded_size(hi) : hash_size(hi);
+    size_t done = 0;
+    if (n > b->n) {
+	free(b->p);
+	b->p = malloc(n);
+	assert(b->p);
+	b->n = n;
+    }
+    if (compress)
+	hash_encode_coded(hi, b->p);
+    else
+	hash_encode(hi, b->p);
+    while (done < n) {
+	ssize_t r = write(fd, b->p + done, n - done);
+	if (r == -1) {
+	    if (errno == EINTR)
+		continue;
+	    return -1;
 	}
-	h->feature[i++] = ntohl(fe);
+	done += r;
     }
-    h->nfeature = i;
-    abort();
-    /*NOTREACHED*/
+    return 0;
+}
+
+static void write_hashfile(void *arg, int worker, int i, char *name,
+			   hashinfo *hi) {
+    char nambuf[MAXPATHLEN + 1];
+    int fd;
+    if (hi == 0) {
+	fprintf(stderr, "%s: warning: not hashed\n", name);
+	return;
+    }
+    strncpy(nambuf, name,
+	    MAXPATHLEN - sizeof(SUFFIX));
+    nambuf[MAXPATHLEN - sizeof(SUFFIX)] = '\0';
+    strcat(nambuf, SUFFIX);
+    fd = open(nambuf, O_WRONLY | O_CREAT | O_TRUNC, 0666);
+    if (fd == -1 || write_hash(hi, fd, worker) == -1 || close(fd) == -1) {
+	perror(name);
+	exit(1);
+    }
+}
+
+/* hashes, and with -r or --files-from their names, as
+   they are made */
+struct kept {
+    pthread_mutex_t lock;
+    int walked;
+    hashinfo **his;
+    char **names;
+    int nalloc;
+};
+
+static void keep_hash(void *arg, int worker, int i, char *name,
+		      hashinfo *hi) {
+    struct kept *k = arg;
+    if (hi)
+	hi = hash_copy(hi);
+    if (hi && compress)
+	hash_compress(hi);
+    if (!k->walked) {
+	k->his[i] = hi;
+	return;
+    }
+    pthread_mutex_lock(&k->lock);
+    if (i >= k->nalloc) {
+	while (i >= k->nalloc)
+	    k->nalloc = 2 * k->nalloc + 1024;
+	k->his = realloc(k->his, k->nalloc * sizeof k->his[0]);
+	k->names = realloc(k->names, k->nalloc * sizeof k->names[0]);
+	assert(k->his && k->names);
+    }
+    k->his[i] = hi;
+    k->names[i] = strdup(name);
+    assert(k->names[i]);
+    pthread_mutex_unlock(&k->lock);
+}
+
+/* Hash the files, keeping them all in memory.  With -r
+   or --files-from, *argc and *argv are replaced with all
+   the files found, named ones included. */
+static hashinfo **keep_hashes(int *argc, char ***argv) {
+    struct kept k;
+    int i;
+    k.walked = nwalk_dir || files_from;
+    if (k.walked) {
+	pthread_mutex_init(&k.lock, 0);
+	k.his = 0;
+	k.names = 0;
+	k.nalloc = 0;
+	*argc = hash_walk(*argc, *argv, keep_hash, &k);
+	pthread_mutex_destroy(&k.lock);
+	*argv = k.names;
+    } else {
+	k.his = malloc(*argc * sizeof k.his[0]);
+	assert(k.his || *argc == 0);
+	hash_files(*argc, *argv, keep_hash, &k);
+    }
+    for (i = 0; i < *argc; i++)
+	if (!k.his[i])
+	    fprintf(stderr, "%s: warning: not hashed\n", (*argv)[i]);
+    return k.his;
+}
+
+static void write_pack(int argc, char **argv) {
+    hashinfo **his = keep_hashes(&argc, &argv);
+    FILE *f;
+    int i;
+    stats_phase(PHASE_OUTPUT);
+    f = fopen(packfile, "w");
+    if (!f || pack_write(f, argc, argv, his) == -1 || fclose(f) == EOF) {
+	perror(packfile);
+	exit(1);
+    }
+    for (i = 0; i < argc; i++)
+	if (his[i])
+	    free_hashinfo(his[i]);
+    free(his);
+    free_names(argc, argv);
+}
+
+/* Write each file's hash next to it, or all of them to
+   the pack.  Without a pack, nothing is kept once it is
+   written, so -r and --files-from can take any number of
+   files. */
+static void write_hashes(int argc, char **argv) {
+    if (packfile)
+	write_pack(argc, argv);
+    else if (nwalk_dir || files_from)
+	hash_walk(argc, argv, write_hashfile, 0);
+    else
+	hash_files(argc, argv, write_hashfile, 0);
+}
+
+/* reads the hash in f, and returns a pointer to it.
+   A null pointer is returned on error. */
+static hashinfo *read_hash(FILE *f) {
+    size_t nalloc = 4096;
+    size_t n = 0;
+    unsigned char *buf = malloc(nalloc);
+    hashinfo *h;
+    assert(buf);
+    while (1) {
+	n += fread(buf + n, 1, nalloc - n, f);
+	if (n < nalloc)
+	    break;
+	nalloc *= 2;
+	buf = realloc(buf, nalloc);
+	assert(buf);
+    }
+    if (ferror(f)) {
+	perror("fread");
+	free(buf);
+	return 0;
+    }
+    h = hash_decode(buf, n);
+    free(buf);
+    if (!h)
+	fprintf(stderr, "bad file version\n");
+    return h;
 }
 
 
@@ -268,70 +645,62 @@ static hashinfo *read_hashfile(char *name) {
 	exit(1);
     }
     hi = read_hash(f);
+    fclose(f);
     return hi;
 }
 
-/* walk backward until one set runs out, counting the
-   number of elements in the union of the sets.  the
-   backward walk is necessary because the common subsets
-   are at the end of the file by construction.  bleah.
-   should probably reformat so that it's the other way
-   around, which would mean that one could shorten a
-   shingleprint by truncation. */
-static double score(hashinfo *hi1, hashinfo *hi2) {
-    double unionsize;
-    double intersectsize;
-    int i1 = hi1->nfeature - 1;
-    int i2 = hi2->nfeature - 1;
-    int count = 0;
-    int matchcount = 0;
-    while(i1 >= 0 && i2 >= 0) {
-	if ((unsigned)(hi1->feature[i1]) < (unsigned)(hi2->feature[i2])) {
-	    --i1;
-	    continue;
-	}
-	if((unsigned)(hi1->feature[i1]) > (unsigned)(hi2->feature[i2])) {
-	    --i2;
-	    continue;
-	}
-	matchcount++;
-	--i1;
-	--i2;
-    }
-    count = hi1->nfeature;
-    if (count > hi2->nfeature)
-	count = hi2->nfeature;
-    intersectsize = matchcount;
-    unionsize = 2 * count - matchcount;
-    return intersectsize / unionsize;
+/* cut hi down to its compare_k smallest features, if
+   asked: they are the shingleprint that -f compare_k
+   would have given.  A signature has no smaller one. */
+static void truncate_hash(hashinfo *hi) {
+    if (hi && !hi->nbits && compare_k > 0 && hi->nfeature > compare_k)
+	hi->nfeature = compare_k;
 }
 
-void print_score(int fieldwidth, double s) {
-    int lead = fieldwidth - 3;
-    int i;
-    for (i = 0; i < lead; i++)
-	printf(" ");
-    if (s == -1) {
-	printf(" ? ");
-    } else if (s == 1.0) {
-	printf("1.0");
-    } else {
-	printf(".%02d", (int)floor(s * 100));
-    }
+/* the hash of name, from the pack p if there is one */
+static hashinfo *find_hash(pack *p, char *name) {
+    hashinfo *hi;
+    if (!p)
+	hi = read_hashfile(name);
+    else if (!(hi = pack_find(p, name)))
+	fprintf(stderr, "%s: not in %s\n", name, packfile);
+    truncate_hash(hi);
+    return hi;
 }
 
 static void compare_hashes(char *name1, char *name2) {
     hashinfo *hi1, *hi2;
-    hi1 = read_hashfile(name1);
+    pack *p = 0;
+    stats_phase(PHASE_READ);
+    if (packfile) {
+	p = pack_open(packfile);
+	if (!p)
+	    exit(1);
+    }
+    hi1 = find_hash(p, name1);
     if (!hi1)
 	exit(1);
-    hi2 = read_hashfile(name2);
+    hi2 = find_hash(p, name2);
     if (!hi2)
 	exit(1);
+    if ((hi1->family ^ hi2->family) & FILE_TOKENS) {
+	fprintf(stderr, "shingle kind mismatch: words vs bytes\n");
+	exit(1);
+    }
+    if (hi1->family != hi2->family) {
+	fprintf(stderr, "hash family mismatch: %s vs %s\n",
+		family_name(hi1->family & FILE_FAMILY),
+		family_name(hi2->family & FILE_FAMILY));
+	exit(1);
+    }
     if (hi1->nshingle != hi2->nshingle) {
 	fprintf(stderr, "shingle size mismatch\n");
 	exit(1);
     }
+    if (hi1->nbits != hi2->nbits) {
+	fprintf(stderr, "signature size mismatch\n");
+	exit(1);
+    }
 #if 0
     /* this isn't normally necessary when things are
        working properly */
@@ -339,107 +708,260 @@ static void compare_hashes(char *name1, char *name2) {
 	fprintf(stderr, "warning: feature set size mismatch %d %d\n",
 		hi1->nfeature, hi2->nfeature);
 #endif
-    print_score(0, score(hi1, hi2));
-    printf("\n");
+    {
+	char buf[SCORE_CHARS + 1];
+	int len;
+	stats_phase(PHASE_SCORE);
+	len = format_score(buf, 0, score(hi1, hi2));
+	stats_scores(1);
+	stats_phase(PHASE_OUTPUT);
+	buf[len++] = '\n';
+	fwrite(buf, 1, len, stdout);
+    }
+    if (p) {
+	pack_close(p);
+	return;
+    }
     free_hashinfo(hi1);
     free_hashinfo(hi2);
 }
 
 
-static int width(int n) {
-    int i = 0;
-    int k = 1;
-    while (k <= n) {
-	k *= 10;
-	i++;
+/* Match the named files, hashing them or finding them in
+   the pack.  With a pack and no names, match everything
+   in the pack. */
+static void match_hashes(int argc, char **argv) {
+    hashinfo **his;
+    pack *p = 0;
+    int i;
+    stats_phase(packfile ? PHASE_READ : PHASE_HASH);
+    if (packfile) {
+	p = pack_open(packfile);
+	if (!p)
+	    exit(1);
+	walk_names(&argc, &argv);
+	if (argc == 0 && !nwalk_dir && !files_from) {
+	    argc = p->ndoc;
+	    argv = p->name;
+	}
+	his = malloc(argc * sizeof *his);
+	assert(his || argc == 0);
+	for (i = 0; i < argc; i++)
+	    his[i] = argv == p->name ? &p->doc[i] : find_hash(p, argv[i]);
+    } else {
+	his = keep_hashes(&argc, &argv);
+    }
+    for (i = 0; i < argc; i++)
+	truncate_hash(his[i]);
+    if (argc > 0) {
+	if (cluster)
+	    match_clusters(stdout, argc, argv, his, threshold,
+			   nband, nrow, njobs);
+	else if (lsh)
+	    match_pairs(stdout, argc, argv, his, threshold,
+			nband, nrow, ntop, njobs);
+	else if (ntop > 0)
+	    match_top(stdout, argc, argv, his, ntop, njobs);
+	else
+	    match_matrix(stdout, argc, argv, his, njobs);
+    }
+    if (p) {
+	pack_close(p);
+    } else {
+	for (i = 0; i < argc; i++)
+	    if (his[i])
+		free_hashinfo(his[i]);
+    }
+    free(his);
+    free_names(argc, argv);
+}
+
+/* Write back the rehash cache, if there is one, first
+   reporting on it if asked. */
+static void close_cache(void) {
+    cache_stats st;
+    if (!rehash_cache)
+	return;
+    if (show_cache_stats) {
+	cache_get_stats(rehash_cache, &st);
+	fprintf(stderr, "%s: %d hits, %d misses, %d added, %d records read\n",
+		cachefile, st.hits, st.misses, st.added, st.records);
+    }
+    if (cache_close(rehash_cache) == -1) {
+	perror(cachefile);
+	exit(1);
     }
-    return i;
+    rehash_cache = 0;
 }
 
-static void print_index(int fieldwidth, int value) {
-    int n = width(value);
-    int lead = fieldwidth - n;
+/* Finish up: write back the rehash cache, and report on
+   the run if asked. */
+static void finish(void) {
+    simhash_counts counts;
     int i;
-    for (i = 0; i < lead; i++)
-	printf(" ");
-    printf("%d", value);
+    stats_phase(PHASE_OUTPUT);
+    close_cache();
+    if (!show_stats)
+	return;
+    memset(&counts, 0, sizeof counts);
+    for (i = 0; i < njobs; i++) {
+	counts.bytes += ctxs[i].counts.bytes;
+	counts.tokens += ctxs[i].counts.tokens;
+	counts.shingles += ctxs[i].counts.shingles;
+	counts.candidates += ctxs[i].counts.candidates;
+	counts.duplicates += ctxs[i].counts.duplicates;
+	counts.evictions += ctxs[i].counts.evictions;
+	counts.hashes += ctxs[i].counts.hashes;
+    }
+    stats_report(stderr, &counts);
 }
 
-static void match_hashes(int argc, char **argv) {
-    hashinfo **his = malloc(argc * sizeof *his);
-    double **scores = malloc(argc * sizeof *scores);
-    int nfilename = 0;
-    int i, j;
-    int fieldwidth;
-    if (argc <= 0)
+/* Hash the files, keeping them all in memory, as
+   keep_hashes() does, and put everything in the pack, if
+   there is one, in front of them.  Sets *n, *names and
+   *his to the lot, and *p to the pack, if any. */
+static void keep_all_hashes(int *argc, char ***argv, int *n, char ***names,
+			    hashinfo ***his, pack **p) {
+    int i;
+    *his = keep_hashes(argc, argv);
+    *n = *argc;
+    *names = *argv;
+    *p = 0;
+    if (!packfile)
 	return;
-    assert(his);
-    assert(scores);
-    /* compute filename hashes */
-    for (i = 0; i < argc; i++)
-	his[i] = hash_filename(argv[i]);
-    /* build score matrix */
-    for (i = 0; i < argc; i++) {
-	scores[i] = malloc(argc * sizeof **scores);
-	assert(scores[i]);
-	for (j = 0; j < i; j++)
-	    if (his[i] && his[j])
-		scores[i][j] = score(his[i], his[j]);
-	    else
-		scores[i][j] = -1;
+    *p = pack_open(packfile);
+    if (!*p)
+	exit(1);
+    *n = (*p)->ndoc + *argc;
+    *names = malloc(*n * sizeof **names);
+    *his = realloc(*his, *n * sizeof **his);
+    assert(*names && *his);
+    memmove(*his + (*p)->ndoc, *his, *argc * sizeof **his);
+    for (i = 0; i < (*p)->ndoc; i++) {
+	(*names)[i] = (*p)->name[i];
+	(*his)[i] = &(*p)->doc[i];
     }
-    /* find maximum filename length */
-    for (i = 0; i < argc; i++) {
-	int n = strlen(argv[i]);
-	if (n > nfilename)
-	    nfilename = n;
-    }
-    /* find the field width */
-    fieldwidth = width(argc);
-    if (fieldwidth < 3)
-	fieldwidth = 3;
-    /* print the first row of indices */
-    for (i = 0; i <= nfilename + fieldwidth; i++)
-	printf(" ");
-    for (i = 1; i < argc - 1; i++) {
-	print_index(fieldwidth, i);
-	printf(" ");
-    }
-    print_index(fieldwidth, argc - 1);
-    printf("\n");
-    /* print the rows of the matrix */
-    for (i = 0; i < argc; i++) {
-	printf("%s", argv[i]);
-	for (j = strlen(argv[i]); j <= nfilename; j++)
-	    printf(" ");
-	print_index(fieldwidth, i + 1);
-	if (i > 0)
-	    printf(" ");
-	for (j = 0; j < i - 1; j++) {
-	    print_score(fieldwidth, scores[i][j]);
-	    printf(" ");
-	}
-	if (i > 0)
-	    print_score(fieldwidth, scores[i][i - 1]);
-	printf("\n");
+    for (i = 0; i < *argc; i++)
+	(*names)[(*p)->ndoc + i] = (*argv)[i];
+}
+
+/* Serve the named files' hashes, and everything in the
+   pack if there is one. */
+static void serve_hashes(int argc, char **argv) {
+    hashinfo **his;
+    char **names;
+    pack *p;
+    int n;
+    keep_all_hashes(&argc, &argv, &n, &names, &his, &p);
+    close_cache();
+    serve(sockname, n, names, his, nshingle, nfeature, hash_family,
+	  nbits, compress);
+}
+
+/* Append the named files' hashes, and everything in the
+   pack if there is one, to the index as a new segment. */
+static void index_hashes(int argc, char **argv) {
+    hashinfo **his;
+    char **names;
+    pack *p;
+    int n, i;
+    stats_phase(PHASE_HASH);
+    keep_all_hashes(&argc, &argv, &n, &names, &his, &p);
+    stats_phase(PHASE_OUTPUT);
+    if (index_append(indexfile, n, names, his) == -1)
+	exit(1);
+    for (i = n - argc; i < n; i++)
+	if (his[i])
+	    free_hashinfo(his[i]);
+    free(his);
+    if (p) {
+	free(names);
+	pack_close(p);
     }
+    free_names(argc, argv);
 }
 
+/* Hash the query file and list the ntop documents in the
+   index most like it, best first, one per line as the
+   similarity followed by the query and document names. */
+static void query_index(char *name) {
+    invindex *x;
+    hashinfo *hi;
+    struct neighbour *best;
+    char buf[SCORE_CHARS];
+    int n, i;
+    stats_phase(PHASE_HASH);
+    if (splittable(name))
+	hi = hash_split(name);
+    else
+	hi = hash_filename(&ctxs[0], name);
+    if (!hi) {
+	fprintf(stderr, "%s: not hashable\n", name);
+	exit(1);
+    }
+    if (hi->nbits) {
+	fprintf(stderr, "simhash: can't look up signatures in an index\n");
+	exit(1);
+    }
+    stats_phase(PHASE_READ);
+    x = index_open(indexfile);
+    if (!x)
+	exit(1);
+    if (x->ndoc > 0 && (x->family != hi->family ||
+			x->nshingle != hi->nshingle)) {
+	fprintf(stderr, "%s: shingle kind, size or hash family "
+		"differs from the query\n", indexfile);
+	exit(1);
+    }
+    stats_phase(PHASE_SCORE);
+    best = malloc(ntop * sizeof best[0]);
+    assert(best);
+    n = index_query(x, hi, ntop, best);
+    stats_phase(PHASE_OUTPUT);
+    for (i = 0; i < n; i++) {
+	fwrite(buf, 1, format_score(buf, 0, best[i].score), stdout);
+	printf(" %s %s\n", name, index_name(x, best[i].hash));
+    }
+    free(best);
+    index_close(x);
+}
 
 static void usage(void) {
     fprintf(stderr, "simhash: usage:\n"
-	    "\tsimhash [-s nshingles] [-f nfeatures] [file]\n"
-	    "\tsimhash [-s nshingles] [-f nfeatures] [-w|-m] file ...\n"
-	    "\tsimhash -c hashfile hashfile\n");
+	    "\tsimhash [-s nshingles] [-f nfeatures] [-H hash] [file]\n"
+	    "\tsimhash [-s nshingles] [-f nfeatures] [-H hash] [-j njobs] [-w|-m] file ...\n"
+	    "\tsimhash [-s nshingles] [-f nfeatures] [-H hash] [-j njobs] -m\n"
+	    "\t\t[--threshold t] [--bands b] [--rows r] [--top n] file ...\n"
+	    "\tsimhash [-s nshingles] [-f nfeatures] [-H hash] [-j njobs] -w --pack pack file ...\n"
+	    "\tsimhash [--compare-k k] [--top n] -m --pack pack [file ...]\n");
+    fprintf(stderr,
+	    "\tsimhash [-s nshingles] [-f nfeatures] [-H hash] [-j njobs]\n"
+	    "\t\t[--bands b] [--rows r] --cluster t file ...\n"
+	    "\tsimhash [--compare-k k] -c hashfile hashfile\n"
+	    "\tsimhash [--compare-k k] -c --pack pack file file\n"
+	    "\tsimhash [-s nshingles] [-f nfeatures] [-H hash] [-j njobs]\n"
+	    "\t\t[--pack pack] --serve socket [file ...]\n"
+	    "\tsimhash [-s nshingles] [-f nfeatures] [-H hash] [-j njobs]\n"
+	    "\t\t[--pack pack] --index index [file ...]\n"
+	    "\tsimhash [-s nshingles] [-f nfeatures] [-H hash]\n"
+	    "\t\t--index index --query file [--top n]\n");
+    fprintf(stderr,
+	    "\tany hashing mode may take [--cache cachefile] [--cache-stats]\n"
+	    "\t\t[--compress] [--mode shingleprint|bitsig] [--bits 64|128]\n"
+	    "\t\t[--tokens nwords] [--no-decompress]\n"
+	    "\t-w, -m, --serve and --index may take [-r dir] ...\n"
+	    "\t\t[--files-from file|-]\n"
+	    "\tany mode but --serve may take [--stats]\n");
     exit(1);
 }
 
 int main(int argc, char **argv) {
+    int i;
     char mode = '?';
-    FILE *fin = stdin;
+    hash_family = HASH_DEFAULT;
     /* parse initial arguments */
     while(1) {
-	switch(getopt_long(argc, argv, "wmcs:f:d",
+	switch(getopt_long(argc, argv, "wmcs:f:dH:j:r:",
 			   long_options, 0)) {
 	case 'w':
 	    mode = 'w';
@@ -466,40 +988,224 @@ int main(int argc, char **argv) {
 	    }
 	    pset = 1;
 	    continue;
+	case 'H':
+	    hash_family = family_code(optarg);
+	    if (!hash_family) {
+		fprintf(stderr, "simhash: unknown hash family %s\n", optarg);
+		exit(1);
+	    }
+	    pset = 1;
+	    continue;
+	case 'j':
+	    njobs = atoi(optarg);
+	    if (njobs < 1) {
+		fprintf(stderr, "simhash: job count must be at least 1\n");
+		exit(1);
+	    }
+	    continue;
+	case 'S':
+	    split_size = atol(optarg);
+	    if (split_size < 1) {
+		fprintf(stderr, "simhash: split size must be at least 1\n");
+		exit(1);
+	    }
+	    continue;
+	case 'V':
+	    use_simd = 0;
+	    continue;
+	case 'P':
+	    packfile = optarg;
+	    continue;
+	case 'K':
+	    compare_k = atoi(optarg);
+	    if (compare_k < 1) {
+		fprintf(stderr, "simhash: compare size must be at least 1\n");
+		exit(1);
+	    }
+	    continue;
+	case 'C':
+	    cachefile = optarg;
+	    continue;
+	case 'A':
+	    show_cache_stats = 1;
+	    continue;
+	case 'Z':
+	    show_stats = 1;
+	    stats_enable();
+	    continue;
+	case 'Q':
+	    compress = 1;
+	    continue;
+	case 'M':
+	    if (!strcmp(optarg, "bitsig")) {
+		nbits = sig_bits;
+	    } else if (!strcmp(optarg, "shingleprint")) {
+		nbits = 0;
+	    } else {
+		fprintf(stderr, "simhash: unknown mode %s\n", optarg);
+		exit(1);
+	    }
+	    pset = 1;
+	    continue;
+	case 'G':
+	    sig_bits = atoi(optarg);
+	    if (sig_bits != 64 && sig_bits != 128) {
+		fprintf(stderr, "simhash: signature bits must be 64 or 128\n");
+		exit(1);
+	    }
+	    if (nbits)
+		nbits = sig_bits;
+	    pset = 1;
+	    continue;
+	case 'W':
+	    ntokens = atoi(optarg);
+	    if (ntokens < 1) {
+		fprintf(stderr, "simhash: token count must be at least 1\n");
+		exit(1);
+	    }
+	    pset = 1;
+	    continue;
+	case 'X':
+	    input_decompress = 0;
+	    continue;
+	case 'r':
+	    walk_dirs = realloc(walk_dirs, (nwalk_dir + 1) * sizeof *walk_dirs);
+	    assert(walk_dirs);
+	    walk_dirs[nwalk_dir++] = optarg;
+	    continue;
+	case 'F':
+	    files_from = optarg;
+	    continue;
+	case 'L':
+	    sockname = optarg;
+	    mode = 'l';
+	    continue;
+	case 'I':
+	    indexfile = optarg;
+	    if (mode != 'q')
+		mode = 'i';
+	    continue;
+	case 'U':
+	    queryfile = optarg;
+	    mode = 'q';
+	    continue;
+	case 'N':
+	    ntop = atoi(optarg);
+	    if (ntop < 1) {
+		fprintf(stderr, "simhash: top count must be at least 1\n");
+		exit(1);
+	    }
+	    continue;
+	case 'T':
+	    threshold = atof(optarg);
+	    if (threshold < 0 || threshold > 1) {
+		fprintf(stderr, "simhash: threshold must be between 0 and 1\n");
+		exit(1);
+	    }
+	    lsh = 1;
+	    continue;
+	case 'Y':
+	    threshold = atof(optarg);
+	    if (threshold < 0 || threshold > 1) {
+		fprintf(stderr, "simhash: threshold must be between 0 and 1\n");
+		exit(1);
+	    }
+	    cluster = 1;
+	    mode = 'm';
+	    continue;
+	case 'B':
+	    nband = atoi(optarg);
+	    if (nband < 1) {
+		fprintf(stderr, "simhash: band count must be at least 1\n");
+		exit(1);
+	    }
+	    lsh = 1;
+	    continue;
+	case 'R':
+	    nrow = atoi(optarg);
+	    if (nrow < 1 || nrow > LSH_MAXROWS) {
+		fprintf(stderr, "simhash: row count must be between 1 and %d\n",
+			LSH_MAXROWS);
+		exit(1);
+	    }
+	    lsh = 1;
+	    continue;
 	case 'd':
 	    debug_trace = 1;
 	}
 	break;
     }
+    if (ntokens) {
+	if (hash_family == HASH_CRC32) {
+	    fprintf(stderr, "simhash: can't shingle words with crc32\n");
+	    exit(1);
+	}
+	nshingle = ntokens;
+	hash_family |= FILE_TOKENS;
+    }
+    simd_init(use_simd);
+    ctxs = malloc(njobs * sizeof *ctxs);
+    outbufs = calloc(njobs, sizeof *outbufs);
+    assert(ctxs && outbufs);
+    for (i = 0; i < njobs; i++) {
+	simhash_init(&ctxs[i], nshingle, nfeature, hash_family);
+	if (nbits)
+	    simhash_bitsig(&ctxs[i], nbits);
+	ctxs[i].debug_trace = debug_trace;
+    }
+    if (cachefile) {
+	rehash_cache = cache_open(cachefile);
+	if (!rehash_cache)
+	    exit(1);
+    }
+    /* found files go to -w, -m, --serve and --index */
+    if ((nwalk_dir || files_from) &&
+	(mode == '?' || mode == 'c' || mode == 'q'))
+	usage();
     /* actually process */
     switch(mode) {
     case '?':
 	switch (argc - optind) {
 	    hashinfo *hi;
 	case 1:
-	    hi = hash_filename(argv[optind]);
+	    stats_phase(PHASE_HASH);
+	    if (splittable(argv[optind]))
+		hi = hash_split(argv[optind]);
+	    else
+		hi = hash_filename(&ctxs[0], argv[optind]);
 	    if (!hi) {
 		fprintf(stderr, "%s: not hashable\n", argv[optind]);
 		return -1;
 	    }
-	    write_hash(hi, stdout);
-	    free_hashinfo(hi);
+	    stats_phase(PHASE_OUTPUT);
+	    if (write_hash(hi, 1, 0) == -1) {
+		perror("stdout");
+		return -1;
+	    }
+	    finish();
 	    return 0;
 	case 0:
-	    hi = hash_file(fin);
+	    stats_phase(PHASE_HASH);
+	    hi = hash_file(&ctxs[0], 0, "stdin");
 	    if (!hi) {
 		fprintf(stderr, "stdin not hashable\n");
 		return -1;
 	    }
-	    write_hash(hi, stdout);
-	    free_hashinfo(hi);
+	    stats_phase(PHASE_OUTPUT);
+	    if (write_hash(hi, 1, 0) == -1) {
+		perror("stdout");
+		return -1;
+	    }
+	    finish();
 	    return 0;
 	}
 	usage();
 	abort();
 	/*NOTREACHED*/
     case 'w':
+	stats_phase(PHASE_HASH);
 	write_hashes(argc - optind, argv + optind);
+	finish();
 	return 0;
     case 'c':
 	if (pset)
@@ -507,9 +1213,28 @@ int main(int argc, char **argv) {
 	if (optind != argc - 2)
 	    usage();
 	compare_hashes(argv[optind], argv[optind + 1]);
+	finish();
 	return 0;
     case 'm':
+	if (cluster && ntop)
+	    usage();
 	match_hashes(argc - optind, argv + optind);
+	finish();
+	return 0;
+    case 'l':
+	serve_hashes(argc - optind, argv + optind);
+	/*NOTREACHED*/
+    case 'i':
+	index_hashes(argc - optind, argv + optind);
+	finish();
+	return 0;
+    case 'q':
+	if (!indexfile || optind != argc || compare_k || packfile)
+	    usage();
+	if (ntop == 0)
+	    ntop = 10;
+	query_index(queryfile);
+	finish();
 	return 0;
     }
     abort();
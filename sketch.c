@@ -0,0 +1,1040 @@
+/*
+ * Copyright © 2005-2009 Bart Massey
+ * ALL RIGHTS RESERVED
+ * [This program is licensed under the "3-clause ('new') BSD License"]
+ * Please see the file COPYING in the source
+ * distribution of this software for license terms.
+ */
+
+/*
+ * Reentrant shingleprint construction: feed the bytes
+ * of a file to simhash_update() in as many pieces as
+ * convenient, then collect the shingleprint with
+ * simhash_finish().  A context allocates all it needs
+ * when it is initialized, so hashing one file after
+ * another with it allocates nothing more, unless the
+ * shingleprints are collected with simhash_finish().
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <assert.h>
+#include "crc.h"
+#include "sketch.h"
+#include "simd.h"
+
+/* shingle positions handed to a vector kernel at a time */
+#define BLOCK 32768
+/* fingerprints folded into a signature at a time, and
+   the most the lanes can count before they are emptied */
+#define SIG_BLOCK 256
+#define SIG_LANE_MAX (255 * 16)
+
+static struct family {
+    char *name;
+    int code;
+} families[] = {
+    {"crc32", HASH_CRC32},
+    {"rabin", HASH_RABIN},
+    {"crc32c", HASH_CRC32C},
+    {0, 0}
+};
+
+char *family_name(int code) {
+    int i;
+    for (i = 0; families[i].name; i++)
+	if (families[i].code == code)
+	    return families[i].name;
+    return 0;
+}
+
+int family_code(char *name) {
+    int i;
+    for (i = 0; families[i].name; i++)
+	if (!strcmp(families[i].name, name))
+	    return families[i].code;
+    return 0;
+}
+
+static size_t rabin_block(simhash_ctx *ctx, const unsigned char *p,
+			  size_t npos, unsigned limit) {
+    return rabin_block_avx2(&ctx->rabin, p, npos, ctx->nshingle,
+			    limit, ctx->survivors);
+}
+
+static size_t crc32c_block(simhash_ctx *ctx, const unsigned char *p,
+			   size_t npos, unsigned limit) {
+    return crc32c_block_sse42(&ctx->crc32c, p, npos, ctx->nshingle,
+			      limit, ctx->survivors);
+}
+
+void simhash_init(simhash_ctx *ctx, int nshingle, int nfeature, int family) {
+    int n;
+    memset(ctx, 0, sizeof *ctx);
+    ctx->nshingle = nshingle;
+    ctx->nfeature = nfeature;
+    ctx->family = family;
+    ctx->buf = malloc(nshingle);
+    assert(ctx->buf);
+    switch (family & FILE_FAMILY) {
+    case HASH_RABIN:
+	rabin_init(&ctx->rabin, nshingle);
+	if (simd_avx2)
+	    ctx->block = rabin_block;
+	break;
+    case HASH_CRC32C:
+	crc32c_init(&ctx->crc32c, nshingle);
+	if (simd_sse42)
+	    ctx->block = crc32c_block;
+	break;
+    }
+    if (family & FILE_TOKENS) {
+	/* words are hashed by appending their bytes */
+	assert((family & FILE_FAMILY) != HASH_CRC32);
+	token_init(&ctx->token, nshingle);
+	ctx->words = malloc(nshingle * sizeof ctx->words[0]);
+	assert(ctx->words);
+	ctx->block = 0;
+    }
+    if (ctx->block) {
+	ctx->survivors = malloc(BLOCK * sizeof ctx->survivors[0]);
+	assert(ctx->survivors);
+    }
+    /* a signature may be asked for later */
+    n = nfeature > SIG_MAXBITS / 32 ? nfeature : SIG_MAXBITS / 32;
+    ctx->hash.feature = malloc((n + 1) * sizeof ctx->hash.feature[0]);
+    assert(ctx->hash.feature);
+    simhash_reset(ctx);
+}
+
+/* From now on, make signatures of nbits bits, a multiple
+   of 32 no more than SIG_MAXBITS, rather than
+   shingleprints. */
+void simhash_bitsig(simhash_ctx *ctx, int nbits) {
+    int b, j;
+    assert(nbits > 0 && nbits % 32 == 0 && nbits <= SIG_MAXBITS);
+    ctx->nbits = nbits;
+    if (!ctx->spread) {
+	ctx->spread = calloc(256, sizeof ctx->spread[0]);
+	assert(ctx->spread);
+	for (b = 0; b < 256; b++)
+	    for (j = 0; j < 8; j++)
+		if (b & (1 << j))
+		    ctx->spread[b][j / 4] |= 1U << (8 * (j % 4));
+    }
+    simhash_reset(ctx);
+}
+
+/* get ready to start a new shingleprint */
+void simhash_reset(simhash_ctx *ctx) {
+    bottomk_reset(&ctx->features, ctx->nfeature);
+    ctx->shingled = 0;
+    memset(ctx->plane, 0, sizeof ctx->plane);
+    memset(ctx->lane, 0, sizeof ctx->lane);
+    ctx->nlane = 0;
+    memset(ctx->count, 0, sizeof ctx->count);
+    ctx->nsig = 0;
+    simhash_restart(ctx);
+}
+
+/* Start a new run of input without forgetting the
+   features already seen.  Shingles do not span runs,
+   so a file split into runs overlapping by nshingle-1
+   bytes yields exactly its own shingles. */
+void simhash_restart(simhash_ctx *ctx) {
+    ctx->nbuf = 0;
+    ctx->oldest = 0;
+    ctx->fp = 0;
+    if (ctx->words)
+	memset(ctx->words, 0, ctx->nshingle * sizeof ctx->words[0]);
+    ctx->word = 0;
+    ctx->inword = 0;
+}
+
+void simhash_free(simhash_ctx *ctx) {
+    bottomk_free(&ctx->features);
+    free(ctx->buf);
+    ctx->buf = 0;
+    free(ctx->survivors);
+    ctx->survivors = 0;
+    free(ctx->words);
+    ctx->words = 0;
+    free(ctx->spread);
+    ctx->spread = 0;
+    free(ctx->hash.feature);
+    ctx->hash.feature = 0;
+    free(ctx->input);
+    ctx->input = 0;
+}
+
+/* empty the planes and lanes into the counts */
+static void sig_flush(simhash_ctx *ctx) {
+    int i;
+    for (i = 0; i < ctx->nbits; i++) {
+	unsigned *plane = ctx->plane[i / 32];
+	int b = i % 32;
+	ctx->count[i] += 16 * ((ctx->lane[i / 4] >> (8 * (i % 4))) & 0xff) +
+	    8 * ((plane[3] >> b) & 1) + 4 * ((plane[2] >> b) & 1) +
+	    2 * ((plane[1] >> b) & 1) + ((plane[0] >> b) & 1);
+    }
+    memset(ctx->plane, 0, sizeof ctx->plane);
+    memset(ctx->lane, 0, sizeof ctx->lane);
+    ctx->nsig += ctx->nlane;
+    ctx->nlane = 0;
+}
+
+/* add one to the lane of each bit set in x */
+static void lane_add(unsigned *lane, unsigned x, unsigned (*spread)[2]) {
+    unsigned *s;
+    s = spread[x & 0xff];
+    lane[0] += s[0];
+    lane[1] += s[1];
+    s = spread[(x >> 8) & 0xff];
+    lane[2] += s[0];
+    lane[3] += s[1];
+    s = spread[(x >> 16) & 0xff];
+    lane[4] += s[0];
+    lane[5] += s[1];
+    s = spread[x >> 24];
+    lane[6] += s[0];
+    lane[7] += s[1];
+}
+
+/* carry-save add: h and l get the high and low bits of
+   each bit's sum of a, b and c */
+#define CSA(h, l, a, b, c) do { \
+	unsigned u_ = (a) ^ (b); \
+	(h) = ((a) & (b)) | (u_ & (c)); \
+	(l) = u_ ^ (c); \
+    } while (0)
+
+/* Fold the n fingerprints fp, n no more than SIG_BLOCK,
+   into the signature: each 32 bits of it come from a
+   fingerprint mixed with a different seed.  Sixteen
+   fingerprints at a time go through a tree of carry-save
+   adders into the planes, as in Harley and Seal's
+   population count, so the lanes see just one word of
+   carries; any left over are added one at a time. */
+static void sig_add_block(simhash_ctx *ctx, const unsigned *fp, int n) {
+    int k, i, j;
+    if (ctx->nlane + n > SIG_LANE_MAX)
+	sig_flush(ctx);
+    for (k = 0; k < ctx->nbits / 32; k++) {
+	unsigned *lane = &ctx->lane[8 * k];
+	unsigned *plane = ctx->plane[k];
+	unsigned seed = (k + 1) * 0x9e3779b9U;
+	unsigned ones = plane[0], twos = plane[1];
+	unsigned fours = plane[2], eights = plane[3];
+	for (i = 0; i + 16 <= n; i += 16) {
+	    unsigned w[16];
+	    unsigned twos_a, twos_b, fours_a, fours_b;
+	    unsigned eights_a, eights_b, sixteens;
+	    for (j = 0; j < 16; j++) {
+		w[j] = fp[i + j] ^ seed;
+		RABIN_MIX(w[j]);
+	    }
+	    CSA(twos_a, ones, ones, w[0], w[1]);
+	    CSA(twos_b, ones, ones, w[2], w[3]);
+	    CSA(fours_a, twos, twos, twos_a, twos_b);
+	    CSA(twos_a, ones, ones, w[4], w[5]);
+	    CSA(twos_b, ones, ones, w[6], w[7]);
+	    CSA(fours_b, twos, twos, twos_a, twos_b);
+	    CSA(eights_a, fours, fours, fours_a, fours_b);
+	    CSA(twos_a, ones, ones, w[8], w[9]);
+	    CSA(twos_b, ones, ones, w[10], w[11]);
+	    CSA(fours_a, twos, twos, twos_a, twos_b);
+	    CSA(twos_a, ones, ones, w[12], w[13]);
+	    CSA(twos_b, ones, ones, w[14], w[15]);
+	    CSA(fours_b, twos, twos, twos_a, twos_b);
+	    CSA(eights_b, fours, fours, fours_a, fours_b);
+	    CSA(sixteens, eights, eights, eights_a, eights_b);
+	    lane_add(lane, sixteens, ctx->spread);
+	}
+	for (; i < n; i++) {
+	    unsigned c = fp[i] ^ seed;
+	    unsigned t;
+	    RABIN_MIX(c);
+	    t = ones & c;
+	    ones ^= c;
+	    c = t;
+	    t = twos & c;
+	    twos ^= c;
+	    c = t;
+	    t = fours & c;
+	    fours ^= c;
+	    c = t;
+	    t = eights & c;
+	    eights ^= c;
+	    if (t)
+		lane_add(lane, t, ctx->spread);
+	}
+	plane[0] = ones;
+	plane[1] = twos;
+	plane[2] = fours;
+	plane[3] = eights;
+    }
+    ctx->nlane += n;
+}
+
+static void sig_add(simhash_ctx *ctx, unsigned fp) {
+    sig_add_block(ctx, &fp, 1);
+}
+
+/* if crc is less than top of heap, replace
+   top-of-heap with crc.  don't worry
+   about sign bits---doesn't matter here. */
+static void crc_insert(simhash_ctx *ctx, unsigned crc) {
+    bottomk *b = &ctx->features;
+    if (ctx->debug_trace)
+	fprintf(stderr, ">got %x\n", crc);
+    if (ctx->nbits) {
+	sig_add(ctx, crc);
+	return;
+    }
+    if (!BOTTOMK_WANTED(b, crc))
+	return;
+    ctx->counts.candidates++;
+    if (bottomk_contains(b, crc)) {
+	if (ctx->debug_trace)
+	    fprintf(stderr, ">dup\n");
+	ctx->counts.duplicates++;
+	return;
+    }
+    if (b->n == b->k) {
+	unsigned m = bottomk_replace_max(b, crc);
+	ctx->counts.evictions++;
+	if (ctx->debug_trace)
+	    fprintf(stderr, ">pop %x\n>push\n", m);
+	return;
+    }
+    if (ctx->debug_trace)
+	fprintf(stderr, ">push\n");
+    bottomk_push(b, crc);
+}
+
+/* the fingerprint of the current shingle */
+static unsigned fingerprint(simhash_ctx *ctx) {
+    unsigned crc = ctx->fp;
+    switch (ctx->family) {
+    case HASH_CRC32:
+	return (unsigned)hash_crc32((char *)ctx->buf,
+				    ctx->oldest, ctx->nshingle);
+    case HASH_RABIN:
+    case HASH_CRC32C:
+	RABIN_MIX(crc);
+	return crc;
+    }
+    abort();
+    /*NOTREACHED*/
+}
+
+/* the running fingerprint with ch appended */
+static unsigned append(simhash_ctx *ctx, unsigned fp, unsigned ch) {
+    if (ctx->family == HASH_CRC32C)
+	return CRC32C_APPEND(&ctx->crc32c, fp, ch);
+    return RABIN_APPEND(&ctx->rabin, fp, ch);
+}
+
+/* the running fingerprint with chin appended, chout dropped */
+static unsigned roll(simhash_ctx *ctx, unsigned fp,
+		     unsigned chin, unsigned chout) {
+    if (ctx->family == HASH_CRC32C)
+	return CRC32C_ROLL(&ctx->crc32c, fp, chin, chout);
+    return RABIN_ROLL(&ctx->rabin, fp, chin, chout);
+}
+
+/* the running fingerprint of the n bytes before p */
+static unsigned restart_fp(simhash_ctx *ctx, const unsigned char *p) {
+    int n = ctx->nshingle;
+    if (ctx->family == HASH_CRC32C)
+	return crc32c_fingerprint(&ctx->crc32c, p - n, n);
+    return rabin_fingerprint(&ctx->rabin, p - n, n);
+}
+
+/* would crc be kept if it were inserted? */
+#define WANTED(ctx, crc) BOTTOMK_WANTED(&(ctx)->features, crc)
+
+/* the scalar inner loops over [p, end), where p[-n] is
+   in the input; returns the running fingerprint */
+static unsigned scalar_run(simhash_ctx *ctx, unsigned fp,
+			   const unsigned char *p,
+			   const unsigned char *end) {
+    int n = ctx->nshingle;
+    rabin *r = &ctx->rabin;
+    crc32c *c = &ctx->crc32c;
+    switch (ctx->family) {
+    case HASH_RABIN:
+	for (; p < end; p++) {
+	    unsigned crc;
+	    fp = RABIN_ROLL(r, fp, p[0], p[-n]);
+	    crc = fp;
+	    RABIN_MIX(crc);
+	    if (WANTED(ctx, crc))
+		crc_insert(ctx, crc);
+	}
+	break;
+    case HASH_CRC32C:
+	for (; p < end; p++) {
+	    unsigned crc;
+	    fp = CRC32C_ROLL(c, fp, p[0], p[-n]);
+	    crc = fp;
+	    RABIN_MIX(crc);
+	    if (WANTED(ctx, crc))
+		crc_insert(ctx, crc);
+	}
+	break;
+    default:
+	abort();
+    }
+    return fp;
+}
+
+/* The inner loop for the rolling fingerprints.  Only
+   the rare fingerprints smaller than the current largest
+   feature make it to crc_insert().  Once n bytes into
+   the input, the byte leaving the window is still in
+   the input, so the window buffer is only touched at
+   the start and the end. */
+static void rolling_run(simhash_ctx *ctx,
+			const unsigned char *bytes,
+			const unsigned char *end) {
+    unsigned char *buf = ctx->buf;
+    int n = ctx->nshingle;
+    int i = ctx->oldest;
+    unsigned fp = ctx->fp;
+    const unsigned char *p = bytes;
+    const unsigned char *ring_end = end;
+    if (end - bytes > n)
+	ring_end = bytes + n;
+    for (; p < ring_end; p++) {
+	unsigned crc;
+	fp = roll(ctx, fp, *p, buf[i]);
+	buf[i] = *p;
+	if (++i == n)
+	    i = 0;
+	crc = fp;
+	RABIN_MIX(crc);
+	if (WANTED(ctx, crc))
+	    crc_insert(ctx, crc);
+    }
+    while (p < end) {
+	const unsigned char *stop = end;
+	/* Once the heap is full, hand long runs to the vector
+	   kernel.  Its limit may be stale by the time its
+	   survivors are inserted, but crc_insert() checks again. */
+	if (ctx->block && ctx->features.n == ctx->nfeature &&
+	    end - p >= BLOCK && p - bytes >= n + 3) {
+	    while (end - p >= BLOCK) {
+		size_t nsurv = ctx->block(ctx, p, BLOCK,
+					  ctx->features.heap[0]);
+		size_t j;
+		for (j = 0; j < nsurv; j++)
+		    crc_insert(ctx, ctx->survivors[j]);
+		p += BLOCK;
+	    }
+	    fp = restart_fp(ctx, p);
+	}
+	/* until the heap fills, check back every so often */
+	if (ctx->block && end - p > BLOCK)
+	    stop = p + BLOCK;
+	fp = scalar_run(ctx, fp, p, stop);
+	p = stop;
+    }
+    if (end - bytes > n) {
+	memcpy(buf, end - n, n);
+	i = 0;
+    }
+    ctx->oldest = i;
+    ctx->fp = fp;
+}
+
+/* The inner loop for signatures from the rolling
+   fingerprints: every shingle counts, so there is
+   nothing to filter, but the window is handled as in
+   rolling_run(). */
+static void sig_run(simhash_ctx *ctx,
+		    const unsigned char *bytes,
+		    const unsigned char *end) {
+    unsigned char *buf = ctx->buf;
+    int n = ctx->nshingle;
+    int i = ctx->oldest;
+    unsigned fp = ctx->fp;
+    const unsigned char *p = bytes;
+    const unsigned char *ring_end = end;
+    if (end - bytes > n)
+	ring_end = bytes + n;
+    for (; p < ring_end; p++) {
+	unsigned crc;
+	fp = roll(ctx, fp, *p, buf[i]);
+	buf[i] = *p;
+	if (++i == n)
+	    i = 0;
+	crc = fp;
+	RABIN_MIX(crc);
+	sig_add(ctx, crc);
+    }
+    while (p < end) {
+	unsigned fps[SIG_BLOCK];
+	int nfp = SIG_BLOCK;
+	int j;
+	if (nfp > end - p)
+	    nfp = end - p;
+	for (j = 0; j < nfp; j++, p++) {
+	    unsigned crc;
+	    fp = roll(ctx, fp, p[0], p[-n]);
+	    crc = fp;
+	    RABIN_MIX(crc);
+	    fps[j] = crc;
+	}
+	sig_add_block(ctx, fps, nfp);
+    }
+    if (end - bytes > n) {
+	memcpy(buf, end - n, n);
+	i = 0;
+    }
+    ctx->oldest = i;
+    ctx->fp = fp;
+}
+
+/* The word whose hash is h has ended: slide it into the
+   window, and fingerprint the window once it is full. */
+static void word_end(simhash_ctx *ctx, unsigned h) {
+    int n = ctx->nshingle;
+    int i = ctx->oldest;
+    unsigned crc;
+    /* a word's hash is no better mixed than a shingle's */
+    RABIN_MIX(h);
+    ctx->counts.tokens++;
+    ctx->fp = TOKEN_ROLL(&ctx->token, ctx->fp, h, ctx->words[i]);
+    ctx->words[i] = h;
+    if (++i == n)
+	i = 0;
+    ctx->oldest = i;
+    if (ctx->nbuf < n && ++ctx->nbuf < n)
+	return;
+    ctx->counts.shingles++;
+    ctx->shingled = 1;
+    crc = ctx->fp;
+    RABIN_MIX(crc);
+    crc_insert(ctx, crc);
+}
+
+/* The tokenizer: hash each word as its bytes go by, in
+   the family's rolling hash, without copying it
+   anywhere.  Nearly every byte is one table lookup for
+   its case and one step of the hash. */
+static void token_run(simhash_ctx *ctx,
+		      const unsigned char *p,
+		      const unsigned char *end) {
+    const unsigned char *fold = ctx->token.fold;
+    unsigned h = ctx->word;
+    int inword = ctx->inword;
+    rabin *r = &ctx->rabin;
+    crc32c *c = &ctx->crc32c;
+    switch (ctx->family & FILE_FAMILY) {
+    case HASH_RABIN:
+	for (; p < end; p++) {
+	    unsigned ch = fold[*p];
+	    if (ch) {
+		h = RABIN_APPEND(r, h, ch);
+		inword = 1;
+	    } else if (inword) {
+		word_end(ctx, h);
+		h = 0;
+		inword = 0;
+	    }
+	}
+	break;
+    case HASH_CRC32C:
+	for (; p < end; p++) {
+	    unsigned ch = fold[*p];
+	    if (ch) {
+		h = CRC32C_APPEND(c, h, ch);
+		inword = 1;
+	    } else if (inword) {
+		word_end(ctx, h);
+		h = 0;
+		inword = 0;
+	    }
+	}
+	break;
+    default:
+	abort();
+    }
+    ctx->word = h;
+    ctx->inword = inword;
+}
+
+/* Shingle the bytes, continuing from wherever the last
+   call left off.  The rolling fingerprints slide along
+   the input a byte at a time, so their cost per byte is
+   independent of nshingle; the CRC32 is recomputed over
+   the whole shingle.  Shingles of words are made by the
+   tokenizer instead. */
+void simhash_update(simhash_ctx *ctx,
+		    const unsigned char *bytes, size_t nbytes) {
+    const unsigned char *end = bytes + nbytes;
+    int n = ctx->nshingle;
+    ctx->counts.bytes += nbytes;
+    if (ctx->family & FILE_TOKENS) {
+	token_run(ctx, bytes, end);
+	return;
+    }
+    while (ctx->nbuf < n) {
+	if (bytes >= end)
+	    return;
+	ctx->buf[ctx->nbuf++] = *bytes;
+	ctx->fp = append(ctx, ctx->fp, *bytes);
+	bytes++;
+	if (ctx->nbuf == n) {
+	    ctx->counts.shingles++;
+	    crc_insert(ctx, fingerprint(ctx));
+	    ctx->shingled = 1;
+	}
+    }
+    /* every byte from here on ends a shingle */
+    ctx->counts.shingles += end - bytes;
+    if (ctx->family != HASH_CRC32 && !ctx->debug_trace) {
+	if (ctx->nbits)
+	    sig_run(ctx, bytes, end);
+	else
+	    rolling_run(ctx, bytes, end);
+	return;
+    }
+    /* buf[oldest] is always the oldest byte in the window */
+    while (bytes < end) {
+	unsigned ch = *bytes++;
+	int i = ctx->oldest;
+	ctx->fp = roll(ctx, ctx->fp, ch, ctx->buf[i]);
+	ctx->buf[i] = ch;
+	if (++i == n)
+	    i = 0;
+	ctx->oldest = i;
+	crc_insert(ctx, fingerprint(ctx));
+    }
+}
+
+/* Add the features seen by other to those of ctx.  The
+   smallest features of a union of inputs are the smallest
+   of the smallest features of each, so shingleprinting
+   pieces of a file separately and merging the results
+   gives exactly the shingleprint of the whole.  The
+   counts of a signature just add. */
+void simhash_merge(simhash_ctx *ctx, simhash_ctx *other) {
+    simhash_counts counts = ctx->counts;
+    int i;
+    assert(ctx->family == other->family &&
+	   ctx->nshingle == other->nshingle &&
+	   ctx->nfeature == other->nfeature &&
+	   ctx->nbits == other->nbits);
+    if (ctx->nbits) {
+	sig_flush(ctx);
+	sig_flush(other);
+	for (i = 0; i < ctx->nbits; i++)
+	    ctx->count[i] += other->count[i];
+	ctx->nsig += other->nsig;
+    }
+    for (i = 0; i < other->features.n; i++)
+	crc_insert(ctx, other->features.heap[i]);
+    /* the counts are of shingling, which merging isn't */
+    ctx->counts = counts;
+    ctx->shingled |= other->shingled;
+}
+
+/* Return the shingleprint of the bytes seen since the
+   last reset, or a null pointer if there were not enough
+   bytes for at least a single shingle.  The hash is the
+   context's own, good until it is next reset: nothing is
+   allocated. */
+hashinfo *simhash_end(simhash_ctx *ctx) {
+    hashinfo *hi = &ctx->hash;
+    int i;
+    /* the end of the input ends a word */
+    if (ctx->inword) {
+	word_end(ctx, ctx->word);
+	ctx->word = 0;
+	ctx->inword = 0;
+    }
+    if (!ctx->shingled)
+	return 0;
+    ctx->counts.hashes++;
+    hi->family = ctx->family;
+    hi->nshingle = ctx->nshingle;
+    hi->coded = 0;
+    hi->nbits = ctx->nbits;
+    if (ctx->nbits) {
+	/* a bit is set if most fingerprints set it */
+	sig_flush(ctx);
+	hi->nfeature = ctx->nbits / 32;
+	memset(hi->feature, 0, hi->nfeature * sizeof hi->feature[0]);
+	for (i = 0; i < ctx->nbits; i++)
+	    if (ctx->count[i] > ctx->nsig - ctx->count[i])
+		hi->feature[i / 32] |= 1U << (i % 32);
+	return hi;
+    }
+    hi->nfeature = ctx->features.n;
+    /* smallest first, so that any prefix is itself
+       a shingleprint */
+    i = ctx->features.n;
+    while (ctx->features.n > 0)
+	hi->feature[--i] = bottomk_extract_max(&ctx->features);
+    return hi;
+}
+
+/* As simhash_end(), but the hash is a copy to keep. */
+hashinfo *simhash_finish(simhash_ctx *ctx) {
+    hashinfo *hi = simhash_end(ctx);
+    return hi ? hash_copy(hi) : 0;
+}
+
+/* a copy of hi, coded if it is */
+hashinfo *hash_copy(hashinfo *hi) {
+    hashinfo *copy = malloc(sizeof *copy);
+    assert(copy);
+    *copy = *hi;
+    if (hi->coded) {
+	size_t n = delta_length(hi->coded, hi->nfeature) + DELTA_SLACK;
+	copy->feature = 0;
+	copy->coded = malloc(n);
+	assert(copy->coded);
+	memcpy(copy->coded, hi->coded, n);
+	return copy;
+    }
+    copy->feature = malloc((hi->nfeature + 1) * sizeof hi->feature[0]);
+    assert(copy->feature);
+    memcpy(copy->feature, hi->feature, hi->nfeature * sizeof hi->feature[0]);
+    return copy;
+}
+
+/* put the n features of an older, largest-first
+   hash into increasing order */
+void reverse_features(unsigned *feature, int n) {
+    int i;
+    for (i = 0; i < n / 2; i++) {
+	unsigned t = feature[i];
+	feature[i] = feature[n - 1 - i];
+	feature[n - 1 - i] = t;
+    }
+}
+
+void free_hashinfo(hashinfo *hi) {
+    free(hi->feature);
+    free(hi->coded);
+    free(hi);
+}
+
+/* the family of a hash with this version word, with
+   FILE_TOKENS if it is of words, or 0 if it isn't a hash
+   we know how to read */
+int version_family(unsigned version) {
+    unsigned flags = FILE_ASCENDING | FILE_DELTA | FILE_BITSIG;
+    if ((version & 0xff00) != FILE_MAGIC ||
+	(version & ~(0xff00 | FILE_KIND | flags)) ||
+	((version & FILE_DELTA) && !(version & FILE_ASCENDING)) ||
+	((version & FILE_BITSIG) && (version & flags) != FILE_BITSIG) ||
+	family_name(version & FILE_FAMILY) == 0)
+	return 0;
+    return version & FILE_KIND;
+}
+
+/* bytes in the hash file form of hi */
+size_t hash_size(hashinfo *hi) {
+    if (hi->coded)
+	return 8 + delta_length(hi->coded, hi->nfeature);
+    return 4 + 4 * (size_t) hi->nfeature;
+}
+
+static unsigned char *put16(unsigned char *p, unsigned v) {
+    *p++ = v >> 8;
+    *p++ = v;
+    return p;
+}
+
+static unsigned char *put32(unsigned char *p, unsigned v) {
+    *p++ = v >> 24;
+    *p++ = v >> 16;
+    *p++ = v >> 8;
+    *p++ = v;
+    return p;
+}
+
+static unsigned get16(const unsigned char *p) {
+    return (p[0] << 8) | p[1];
+}
+
+static unsigned get32(const unsigned char *p) {
+    return ((unsigned) p[0] << 24) | (p[1] << 16) | (p[2] << 8) | p[3];
+}
+
+/* Put the hash file form of hi in buf, which must hold
+   hash_size(hi) bytes: the version, the shingle size,
+   then the features, all big-endian.  A coded hash has
+   the number of features and then their code instead;
+   a signature has its words. */
+void hash_encode(hashinfo *hi, unsigned char *buf) {
+    int i;
+    if (hi->coded) {
+	buf = put16(buf, FILE_MAGIC | FILE_ASCENDING | FILE_DELTA |
+		    hi->family);
+	buf = put16(buf, hi->nshingle);
+	buf = put32(buf, hi->nfeature);
+	memcpy(buf, hi->coded, delta_length(hi->coded, hi->nfeature));
+	return;
+    }
+    buf = put16(buf, FILE_MAGIC | hi->family |
+		(hi->nbits ? FILE_BITSIG : FILE_ASCENDING));
+    buf = put16(buf, hi->nshingle);
+    for (i = 0; i < hi->nfeature; i++)
+	buf = put32(buf, hi->feature[i]);
+}
+
+/* bytes in the hash file form of hi, coded as by
+   hash_compress() if it is not a signature */
+size_t hash_coded_size(hashinfo *hi) {
+    if (hi->coded || hi->nbits)
+	return hash_size(hi);
+    return 8 + delta_size(hi->feature, hi->nfeature);
+}
+
+/* Put the hash file form of hi, coded as by
+   hash_compress(), in buf, which must hold
+   hash_coded_size(hi) bytes.  Unlike compressing hi and
+   then encoding it, this allocates nothing. */
+void hash_encode_coded(hashinfo *hi, unsigned char *buf) {
+    size_t n;
+    if (hi->coded || hi->nbits) {
+	hash_encode(hi, buf);
+	return;
+    }
+    n = delta_size(hi->feature, hi->nfeature);
+    buf = put16(buf, FILE_MAGIC | FILE_ASCENDING | FILE_DELTA | hi->family);
+    buf = put16(buf, hi->nshingle);
+    buf = put32(buf, hi->nfeature);
+    memset(buf, 0, n);
+    delta_put(buf, hi->feature, hi->nfeature);
+}
+
+/* The hash whose file form is the n bytes of buf, or a
+   null pointer if they aren't one.  A trailing partial
+   feature is ignored.  A coded hash stays coded. */
+hashinfo *hash_decode(const unsigned char *buf, size_t n) {
+    hashinfo *hi;
+    unsigned version;
+    size_t used;
+    int i;
+    if (n < 4)
+	return 0;
+    version = get16(buf);
+    if (!version_family(version))
+	return 0;
+    if ((version & FILE_DELTA) &&
+	(n < 8 || get32(buf + 4) > 0x7fffffff ||
+	 !delta_check(buf + 8, n - 8, get32(buf + 4), &used)))
+	return 0;
+    if ((version & FILE_BITSIG) &&
+	(n / 4 < 2 || n / 4 - 1 > SIG_MAXBITS / 32))
+	return 0;
+    hi = malloc(sizeof *hi);
+    assert(hi);
+    hi->family = version & FILE_KIND;
+    hi->nshingle = get16(buf + 2);
+    hi->feature = 0;
+    hi->coded = 0;
+    hi->nbits = 0;
+    if (version & FILE_DELTA) {
+	hi->nfeature = get32(buf + 4);
+	hi->coded = calloc(used + DELTA_SLACK, 1);
+	assert(hi->coded);
+	memcpy(hi->coded, buf + 8, used);
+	return hi;
+    }
+    hi->nfeature = n / 4 - 1;
+    hi->feature = malloc((hi->nfeature + 1) * sizeof hi->feature[0]);
+    assert(hi->feature);
+    for (i = 0; i < hi->nfeature; i++)
+	hi->feature[i] = get32(buf + 4 + 4 * i);
+    if (version & FILE_BITSIG)
+	hi->nbits = 32 * hi->nfeature;
+    else if (!(version & FILE_ASCENDING))
+	reverse_features(hi->feature, hi->nfeature);
+    return hi;
+}
+
+/* Feature codes: each feature less the one before it
+   (the first less 0), all in the same number of bits,
+   the fewest that hold the biggest difference.  The
+   first byte is the number of bits, and the differences
+   follow, packed low bits first.  Features are distinct
+   and increasing, so a sketch of k features spread over
+   the 32-bit range takes a little over log2(range / k)
+   bits each.  Every difference is at a known place, so
+   decoding is a shift and a mask per feature. */
+
+static unsigned width_mask(int width) {
+    return width == 32 ? 0xffffffffU : (1U << width) - 1;
+}
+
+/* bytes of the code of n features of width bits */
+static size_t code_bytes(int n, int width) {
+    return 1 + ((size_t) n * width + 7) / 8;
+}
+
+/* bits in v, not counting leading zeros */
+static int bit_width(unsigned v) {
+    int n = 0;
+    while (v) {
+	v >>= 1;
+	n++;
+    }
+    return n;
+}
+
+static int delta_width(const unsigned *feature, int n) {
+    unsigned prev = 0;
+    unsigned all = 0;
+    int i;
+    for (i = 0; i < n; i++) {
+	all |= feature[i] - prev;
+	prev = feature[i];
+    }
+    return bit_width(all);
+}
+
+/* bytes of the code for feature[0 .. n - 1] */
+size_t delta_size(const unsigned *feature, int n) {
+    return code_bytes(n, delta_width(feature, n));
+}
+
+/* Code feature[0 .. n - 1] into p, which must hold
+   delta_size() bytes, all zero. */
+void delta_put(unsigned char *p, const unsigned *feature, int n) {
+    int width = delta_width(feature, n);
+    unsigned long bit = 0;
+    unsigned prev = 0;
+    int i;
+    *p++ = width;
+    /* all the features are 0, and take no bits */
+    if (width == 0)
+	return;
+    for (i = 0; i < n; i++) {
+	unsigned d = feature[i] - prev;
+	int shift = bit & 7;
+	unsigned char *q = p + (bit >> 3);
+	int left = width + shift;
+	/* the low bits of this byte may be the last feature's */
+	*q++ |= d << shift;
+	d >>= 8 - shift;
+	for (left -= 8; left > 0; left -= 8) {
+	    *q++ = d;
+	    d >>= 8;
+	}
+	bit += width;
+	prev = feature[i];
+    }
+}
+
+/* bytes of the code of the first n features coded at p */
+size_t delta_length(const unsigned char *p, int n) {
+    return code_bytes(n, p[0]);
+}
+
+static int little_endian(void) {
+    unsigned one = 1;
+    return *(unsigned char *) &one;
+}
+
+/* Decode the n features coded at p into feature.  On a
+   little-endian machine, a difference of up to 25 bits
+   is always within the word loaded at its first byte. */
+void delta_get(const unsigned char *p, unsigned *feature, int n) {
+    int width = p[0];
+    unsigned mask = width_mask(width);
+    unsigned long bit = 0;
+    unsigned v = 0;
+    int i;
+    p++;
+    if (width <= 25 && little_endian()) {
+	for (i = 0; i < n; i++) {
+	    unsigned w;
+	    memcpy(&w, p + (bit >> 3), sizeof w);
+	    v += (w >> (bit & 7)) & mask;
+	    bit += width;
+	    feature[i] = v;
+	}
+	return;
+    }
+    for (i = 0; i < n; i++) {
+	v += DELTA_BITS(p, bit, mask);
+	bit += width;
+	feature[i] = v;
+    }
+}
+
+/* Check that the n bytes at p start with the code of
+   nfeature increasing features, setting *used to the
+   bytes of it.  Returns 0 if they don't. */
+int delta_check(const unsigned char *p, size_t n, int nfeature,
+		size_t *used) {
+    unsigned long v = 0;
+    unsigned long bit = 0;
+    unsigned mask;
+    int width;
+    int i;
+    if (n < 1 || p[0] > 32)
+	return 0;
+    width = p[0];
+    mask = width_mask(width);
+    if (code_bytes(nfeature, width) > n)
+	return 0;
+    for (i = 0; i < nfeature; i++) {
+	unsigned long d;
+	/* the word read may run past the code: read
+	   just the bytes that are there */
+	int j, nbyte = ((bit & 7) + width + 7) / 8;
+	d = 0;
+	for (j = nbyte - 1; j >= 0; j--)
+	    d = (d << 8) | p[1 + (bit >> 3) + j];
+	d = (d >> (bit & 7)) & mask;
+	if ((i > 0 && d == 0) || d > 0xffffffffUL - v)
+	    return 0;
+	v += d;
+	bit += width;
+    }
+    *used = code_bytes(nfeature, width);
+    return 1;
+}
+
+/* code the features of hi in place; a signature is
+   left alone */
+void hash_compress(hashinfo *hi) {
+    unsigned char *p;
+    if (hi->coded || hi->nbits)
+	return;
+    p = calloc(delta_size(hi->feature, hi->nfeature) + DELTA_SLACK, 1);
+    assert(p);
+    delta_put(p, hi->feature, hi->nfeature);
+    free(hi->feature);
+    hi->feature = 0;
+    hi->coded = p;
+}
+
+/* decode the features of hi in place */
+void hash_expand(hashinfo *hi) {
+    if (!hi->coded)
+	return;
+    hi->feature = malloc((hi->nfeature + 1) * sizeof hi->feature[0]);
+    assert(hi->feature);
+    delta_get(hi->coded, hi->feature, hi->nfeature);
+    free(hi->coded);
+    hi->coded = 0;
+}
+
+/* The features of hi, decoded into buf, which must hold
+   hi->nfeature of them, if hi is coded. */
+const unsigned *hash_features(hashinfo *hi, unsigned *buf) {
+    if (!hi->coded)
+	return hi->feature;
+    delta_get(hi->coded, buf, hi->nfeature);
+    return buf;
+}
@@ -0,0 +1,159 @@
+/*
+ * Copyright © 2005-2009 Bart Massey
+ * ALL RIGHTS RESERVED
+ * [This program is licensed under the "3-clause ('new') BSD License"]
+ * Please see the file COPYING in the source
+ * distribution of this software for license terms.
+ */
+
+#include <stddef.h>
+#include "rabin.h"
+#include "crc32c.h"
+#include "bottomk.h"
+#include "token.h"
+
+/* fingerprint families */
+#define HASH_CRC32 0x01   /* CRC32 of each shingle */
+#define HASH_RABIN 0x02   /* rolling Rabin fingerprint */
+#define HASH_CRC32C 0x03  /* rolling CRC32C */
+#define HASH_DEFAULT HASH_RABIN
+
+/* HASH FILE VERSION: the low bits of the low byte name
+   the fingerprint family, so that hashes from different
+   families are never compared; the high bits are flags.
+   FILE_TOKENS is part of the family, in the sense that a
+   family and its shingles of words are never compared. */
+#define FILE_MAGIC 0xcb00
+#define FILE_FAMILY 0x0f     /* mask for the family */
+#define FILE_ASCENDING 0x80  /* features smallest first */
+#define FILE_DELTA 0x40      /* features delta coded and bit-packed */
+#define FILE_BITSIG 0x20     /* a signature, not features */
+#define FILE_TOKENS 0x10     /* shingles of words, not bytes */
+#define FILE_KIND (FILE_FAMILY | FILE_TOKENS)
+
+/* most bits in a signature */
+#define SIG_MAXBITS 128
+
+typedef struct hashinfo {
+    unsigned short family;  /* with FILE_TOKENS for words */
+    unsigned short nshingle;
+    unsigned int nfeature;
+    unsigned *feature;      /* in increasing order */
+    unsigned char *coded;   /* or, if not null, these instead:
+			       the features coded as by delta_put() */
+    int nbits;              /* if nonzero, feature is instead a
+			       signature of this many bits, in
+			       nfeature words, low bits first */
+} hashinfo;
+
+/* bytes that must be readable after the end of a code,
+   so that it can be decoded a word at a time */
+#define DELTA_SLACK 4
+
+/* The difference at bit offset bit of the packed
+   differences at p, where mask has the low width bits
+   set: the word at the byte holding its first bit,
+   shifted down, and the bits of the byte after that it
+   may run into. */
+#define DELTA_BITS(p, bit, mask) \
+    ((((unsigned) (p)[((bit) >> 3)] | \
+       (unsigned) (p)[((bit) >> 3) + 1] << 8 | \
+       (unsigned) (p)[((bit) >> 3) + 2] << 16 | \
+       (unsigned) (p)[((bit) >> 3) + 3] << 24) >> ((bit) & 7) | \
+      (unsigned) (p)[((bit) >> 3) + 4] << 1 << (31 - ((bit) & 7))) & (mask))
+
+/* What a context has done since it was initialized.
+   Shingles not among the candidates were rejected at a
+   glance, as bigger than the biggest feature kept. */
+typedef struct simhash_counts {
+    unsigned long bytes;       /* given to simhash_update() */
+    unsigned long tokens;      /* words, when shingling words */
+    unsigned long shingles;    /* fingerprinted */
+    unsigned long candidates;  /* small enough to be looked at */
+    unsigned long duplicates;  /* candidates already kept */
+    unsigned long evictions;   /* features displaced by candidates */
+    unsigned long hashes;      /* shingleprints finished */
+} simhash_counts;
+
+/* Everything needed to build one shingleprint.  Contexts
+   share no state, so any number of them may be in use
+   at once, one per thread. */
+typedef struct simhash_ctx {
+    int nshingle;           /* in words, with FILE_TOKENS */
+    int nfeature;
+    int family;             /* and FILE_TOKENS, if given it */
+    int debug_trace;
+    bottomk features;       /* the smallest features seen */
+    unsigned char *buf;     /* the current shingle */
+    int nbuf;               /* bytes (or words) of the window
+			       filled so far */
+    int oldest;             /* index in buf (or words) of the oldest */
+    unsigned fp;            /* running fingerprint of buf */
+    int shingled;           /* seen at least one whole shingle? */
+    rabin rabin;
+    crc32c crc32c;
+    /* With FILE_TOKENS, the window is of the hashes of
+       words; the word being read may run on from one
+       update to the next. */
+    token token;
+    unsigned *words;        /* the window */
+    unsigned word;          /* hash of the word so far */
+    int inword;             /* in a word? */
+    /* vector kernel for long runs of input, if any */
+    size_t (*block)(struct simhash_ctx *ctx, const unsigned char *p,
+		    size_t npos, unsigned limit);
+    unsigned *survivors;    /* fingerprints passed by the kernel */
+    simhash_counts counts;
+    /* With nbits set, every fingerprint is instead folded
+       into a signature of nbits bits.  Each bit counts the
+       fingerprints that would set it: the low four bits
+       of the counts are kept bit-sliced, four words for
+       each 32 bits of signature, the carries out of them
+       go to byte-wide lanes, and the lanes are emptied
+       into count before they can overflow. */
+    int nbits;
+    unsigned (*spread)[2];  /* the lanes each byte adds to */
+    unsigned plane[SIG_MAXBITS / 32][4];
+    unsigned lane[SIG_MAXBITS / 4];
+    int nlane;              /* fingerprints since emptied */
+    unsigned long count[SIG_MAXBITS];
+    unsigned long nsig;     /* fingerprints folded in */
+    /* the hash simhash_end() lends out, with room for
+       nfeature features or a whole signature */
+    hashinfo hash;
+    unsigned char *input;   /* read buffer for input.c,
+			       made when first needed */
+} simhash_ctx;
+
+extern void simhash_init(simhash_ctx *ctx,
+			 int nshingle, int nfeature, int family);
+extern void simhash_bitsig(simhash_ctx *ctx, int nbits);
+extern void simhash_reset(simhash_ctx *ctx);
+extern void simhash_restart(simhash_ctx *ctx);
+extern void simhash_merge(simhash_ctx *ctx, simhash_ctx *other);
+extern void simhash_update(simhash_ctx *ctx,
+			   const unsigned char *bytes, size_t nbytes);
+extern hashinfo *simhash_end(simhash_ctx *ctx);
+extern hashinfo *simhash_finish(simhash_ctx *ctx);
+extern void simhash_free(simhash_ctx *ctx);
+
+extern void reverse_features(unsigned *feature, int n);
+extern hashinfo *hash_copy(hashinfo *hi);
+extern void free_hashinfo(hashinfo *hi);
+extern char *family_name(int code);
+extern int family_code(char *name);
+extern int version_family(unsigned version);
+extern size_t hash_size(hashinfo *hi);
+extern void hash_encode(hashinfo *hi, unsigned char *buf);
+extern size_t hash_coded_size(hashinfo *hi);
+extern void hash_encode_coded(hashinfo *hi, unsigned char *buf);
+extern hashinfo *hash_decode(const unsigned char *buf, size_t n);
+extern size_t delta_size(const unsigned *feature, int n);
+extern void delta_put(unsigned char *p, const unsigned *feature, int n);
+extern size_t delta_length(const unsigned char *p, int n);
+extern void delta_get(const unsigned char *p, unsigned *feature, int n);
+extern int delta_check(const unsigned char *p, size_t n, int nfeature,
+		       size_t *used);
+extern void hash_compress(hashinfo *hi);
+extern void hash_expand(hashinfo *hi);
+extern const unsigned *hash_features(hashinfo *hi, unsigned *buf);
@@ -0,0 +1,102 @@
+/*
+ * Copyright © 2005-2009 Bart Massey
+ * ALL RIGHTS RESERVED
+ * [This program is licensed under the "3-clause ('new') BSD License"]
+ * Please see the file COPYING in the source
+ * distribution of this software for license terms.
+ */
+
+/*
+ * Run statistics for --stats: wall and CPU time in each
+ * phase of the run, the number of scores computed, and
+ * the shingling counts kept by each context, reported
+ * as JSON.  The program is in one phase at a time, and
+ * changes phase only from its main thread, so CPU time
+ * for the whole process, all threads included, can be
+ * charged to the phase.  Until stats_enable() is called,
+ * changing phase costs nothing.
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <time.h>
+#include <sys/time.h>
+#include <sys/resource.h>
+#include "sketch.h"
+#include "stats.h"
+
+static char *phase_names[NPHASE] = {"read", "hash", "score", "output"};
+
+static struct {
+    int enabled;
+    int phase;
+    double start_wall, start_cpu;   /* of the current phase */
+    double wall[NPHASE], cpu[NPHASE];
+    unsigned long scores;
+} stats = {0, PHASE_NONE};
+
+static double clock_seconds(clockid_t id) {
+    struct timespec ts;
+    clock_gettime(id, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+void stats_enable(void) {
+    stats.enabled = 1;
+}
+
+/* Charge the time since the last change of phase to the
+   phase then, and start timing phase. */
+void stats_phase(int phase) {
+    double wall, cpu;
+    if (!stats.enabled)
+	return;
+    wall = clock_seconds(CLOCK_MONOTONIC);
+    cpu = clock_seconds(CLOCK_PROCESS_CPUTIME_ID);
+    if (stats.phase != PHASE_NONE) {
+	stats.wall[stats.phase] += wall - stats.start_wall;
+	stats.cpu[stats.phase] += cpu - stats.start_cpu;
+    }
+    stats.phase = phase;
+    stats.start_wall = wall;
+    stats.start_cpu = cpu;
+}
+
+/* n more pairs of hashes were scored */
+void stats_scores(unsigned long n) {
+    stats.scores += n;
+}
+
+/* End the current phase, and write everything, with the
+   shingling counts of all contexts, to f as a JSON object. */
+void stats_report(FILE *f, simhash_counts *counts) {
+    struct rusage ru;
+    double wall = 0, cpu = 0;
+    int i;
+    stats_phase(PHASE_NONE);
+    fprintf(f, "{\n");
+    fprintf(f, "  \"bytes\": %lu,\n", counts->bytes);
+    fprintf(f, "  \"tokens\": %lu,\n", counts->tokens);
+    fprintf(f, "  \"shingles\": %lu,\n", counts->shingles);
+    fprintf(f, "  \"rejects\": %lu,\n", counts->shingles - counts->candidates);
+    fprintf(f, "  \"candidates\": %lu,\n", counts->candidates);
+    fprintf(f, "  \"duplicates\": %lu,\n", counts->duplicates);
+    fprintf(f, "  \"evictions\": %lu,\n", counts->evictions);
+    fprintf(f, "  \"hashes\": %lu,\n", counts->hashes);
+    fprintf(f, "  \"scores\": %lu,\n", stats.scores);
+    fprintf(f, "  \"phases\": {\n");
+    for (i = 0; i < NPHASE; i++) {
+	fprintf(f, "    \"%s\": {\"wall\": %.6f, \"cpu\": %.6f}%s\n",
+		phase_names[i], stats.wall[i], stats.cpu[i],
+		i < NPHASE - 1 ? "," : "");
+	wall += stats.wall[i];
+	cpu += stats.cpu[i];
+    }
+    fprintf(f, "  },\n");
+    fprintf(f, "  \"wall\": %.6f,\n", wall);
+    fprintf(f, "  \"cpu\": %.6f,\n", cpu);
+    getrusage(RUSAGE_SELF, &ru);
+    /* kilobytes, on Linux */
+    fprintf(f, "  \"max_rss_kb\": %ld\n", ru.ru_maxrss);
+    fprintf(f, "}\n");
+}
@@ -0,0 +1,20 @@
+/*
+ * Copyright © 2005-2009 Bart Massey
+ * ALL RIGHTS RESERVED
+ * [This program is licensed under the "3-clause ('new') BSD License"]
+ * Please see the file COPYING in the source
+ * distribution of this software for license terms.
+ */
+
+/* what the program is doing, for timing */
+#define PHASE_NONE -1
+#define PHASE_READ 0      /* loading hashes */
+#define PHASE_HASH 1      /* reading and hashing files */
+#define PHASE_SCORE 2     /* comparing hashes */
+#define PHASE_OUTPUT 3    /* writing results */
+#define NPHASE 4
+
+extern void stats_enable(void);
+extern void stats_phase(int phase);
+extern void stats_scores(unsigned long n);
+extern void stats_report(FILE *f, simhash_counts *counts);
@@ -0,0 +1,37 @@
+/*
+ * Copyright © 2005-2009 Bart Massey
+ * ALL RIGHTS RESERVED
+ * [This program is licensed under the "3-clause ('new') BSD License"]
+ * Please see the file COPYING in the source
+ * distribution of this software for license terms.
+ */
+
+/*
+ * Word shingles.  A word is a run of ASCII letters and
+ * digits, and of bytes with the high bit set, so that
+ * UTF-8 text stays in one piece; everything else only
+ * separates words.  Letters are folded to lower case as
+ * they are read.  A window of words is hashed as the
+ * polynomial in TOKEN_MULT, modulo 2^32, whose
+ * coefficients are the hashes of the words, so sliding
+ * it one word costs two multiplies.
+ */
+
+#include <ctype.h>
+#include "token.h"
+
+void token_init(token *t, int nwindow) {
+    int ch, i;
+    for (ch = 0; ch < 256; ch++) {
+	if (ch >= 0x80)
+	    t->fold[ch] = ch;
+	else if (isalnum(ch))
+	    t->fold[ch] = tolower(ch);
+	else
+	    t->fold[ch] = 0;
+    }
+    /* TOKEN_MULT^nwindow */
+    t->out = 1;
+    for (i = 0; i < nwindow; i++)
+	t->out *= TOKEN_MULT;
+}
@@ -0,0 +1,25 @@
+/*
+ * Copyright © 2005-2009 Bart Massey
+ * ALL RIGHTS RESERVED
+ * [This program is licensed under the "3-clause ('new') BSD License"]
+ * Please see the file COPYING in the source
+ * distribution of this software for license terms.
+ */
+
+/* tables for a rolling hash of a window of nwindow words */
+typedef struct token {
+    unsigned char fold[256];  /* each byte in lower case, or 0
+				 if it is not part of a word */
+    unsigned out;             /* contribution of the word leaving
+				 the window, per unit of its hash */
+} token;
+
+/* the multiplier of the window's polynomial hash */
+#define TOKEN_MULT 0x9e3779b1U
+
+/* append word hash win and drop word hash wout, keeping
+   the window size fixed; a window not yet full drops 0 */
+#define TOKEN_ROLL(t, fp, win, wout) \
+    ((fp) * TOKEN_MULT + (win) - (wout) * (t)->out)
+
+extern void token_init(token *t, int nwindow);
@@ -0,0 +1,250 @@
+/*
+ * Copyright © 2005-2009 Bart Massey
+ * ALL RIGHTS RESERVED
+ * [This program is licensed under the "3-clause ('new') BSD License"]
+ * Please see the file COPYING in the source
+ * distribution of this software for license terms.
+ */
+
+/*
+ * Finding the files to hash, for corpora too big for
+ * the command line.  Two stages, each a thread, run
+ * ahead of the hashing: the walker lists the files
+ * named outright, then those found in the trees given,
+ * then those named in a file; the reader opens each and
+ * asks the kernel to start reading it, so that its first
+ * blocks are in memory by the time a hashing thread gets
+ * to it.  Bounded queues join the stages, so however many
+ * files there are, only a few are ever waiting.  The
+ * trees are walked in order of name, so the files come
+ * out in the same order every time.  A file's record
+ * is used again once it has been hashed, so that a long
+ * list of names costs no more than a short one.
+ */
+
+#define _GNU_SOURCE
+#define _FILE_OFFSET_BITS 64
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <assert.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "queue.h"
+#include "walk.h"
+
+/* names waiting to be opened */
+#define NAMES 1024
+/* bytes at the start of each file to read ahead */
+#define PREFETCH (4 * 1024 * 1024)
+
+struct walk {
+    walk_sources src;
+    queue names;            /* found, not yet opened */
+    queue ready;            /* opened and being read ahead */
+    pthread_t walker, reader;
+    pthread_mutex_t lock;
+    walk_file *spare;       /* records done with */
+    int nfound;
+    int error;              /* couldn't read files_from? */
+};
+
+static void found(walk *w, char *name) {
+    size_t n = strlen(name) + 1;
+    walk_file *f;
+    pthread_mutex_lock(&w->lock);
+    f = w->spare;
+    if (f)
+	w->spare = f->next;
+    pthread_mutex_unlock(&w->lock);
+    if (!f) {
+	f = malloc(sizeof *f);
+	assert(f);
+	f->name = 0;
+	f->nname = 0;
+    }
+    if (n > f->nname) {
+	free(f->name);
+	f->name = malloc(n);
+	assert(f->name);
+	f->nname = n;
+    }
+    memcpy(f->name, name, n);
+    f->index = w->nfound++;
+    f->fd = -1;
+    queue_put(&w->names, f);
+}
+
+static int skipped(walk *w, char *name) {
+    size_t n = strlen(name);
+    size_t ns;
+    if (!w->src.skip)
+	return 0;
+    ns = strlen(w->src.skip);
+    return n >= ns && !strcmp(name + n - ns, w->src.skip);
+}
+
+static int name_cmp(const struct dirent **a, const struct dirent **b) {
+    return strcmp((*a)->d_name, (*b)->d_name);
+}
+
+/* Find the regular files under path.  Symbolic links are
+   not followed, so the walk can't loop.  Directories
+   that can't be read are reported and passed over, as
+   find does. */
+static void walk_dir(walk *w, char *path) {
+    struct dirent **list;
+    size_t npath = strlen(path);
+    int n, i;
+    n = scandir(path, &list, 0, name_cmp);
+    if (n == -1) {
+	perror(path);
+	return;
+    }
+    for (i = 0; i < n; i++) {
+	char *name = list[i]->d_name;
+	int type = list[i]->d_type;
+	char *child;
+	if (!strcmp(name, ".") || !strcmp(name, "..")) {
+	    free(list[i]);
+	    continue;
+	}
+	child = malloc(npath + strlen(name) + 2);
+	assert(child);
+	strcpy(child, path);
+	if (npath == 0 || path[npath - 1] != '/')
+	    strcat(child, "/");
+	strcat(child, name);
+	free(list[i]);
+	if (type == DT_UNKNOWN) {
+	    struct stat st;
+	    if (lstat(child, &st) == 0) {
+		if (S_ISDIR(st.st_mode))
+		    type = DT_DIR;
+		else if (S_ISREG(st.st_mode))
+		    type = DT_REG;
+	    }
+	}
+	if (type == DT_DIR)
+	    walk_dir(w, child);
+	else if (type == DT_REG && !skipped(w, child))
+	    found(w, child);
+	free(child);
+    }
+    free(list);
+}
+
+/* the names in files_from, each ended by a NUL */
+static void walk_list(walk *w) {
+    char *name = 0;
+    size_t nalloc = 0;
+    FILE *f = stdin;
+    if (strcmp(w->src.files_from, "-")) {
+	f = fopen(w->src.files_from, "r");
+	if (!f) {
+	    perror(w->src.files_from);
+	    w->error = 1;
+	    return;
+	}
+    }
+    while (getdelim(&name, &nalloc, '\0', f) != -1)
+	if (name[0])
+	    found(w, name);
+    if (ferror(f)) {
+	perror(w->src.files_from);
+	w->error = 1;
+    }
+    free(name);
+    if (f != stdin)
+	fclose(f);
+}
+
+static void *walker(void *arg) {
+    walk *w = arg;
+    int i;
+    for (i = 0; i < w->src.nname; i++)
+	found(w, w->src.name[i]);
+    for (i = 0; i < w->src.ndir; i++)
+	walk_dir(w, w->src.dir[i]);
+    if (w->src.files_from)
+	walk_list(w);
+    queue_close(&w->names);
+    return 0;
+}
+
+static void *reader(void *arg) {
+    walk *w = arg;
+    walk_file *f;
+    while ((f = queue_get(&w->names))) {
+	f->fd = open(f->name, O_RDONLY);
+	if (f->fd == -1)
+	    perror(f->name);
+	else
+	    posix_fadvise(f->fd, 0, PREFETCH, POSIX_FADV_WILLNEED);
+	queue_put(&w->ready, f);
+    }
+    queue_close(&w->ready);
+    return 0;
+}
+
+/* Start finding the files of src, keeping up to nready
+   of them open and read ahead. */
+walk *walk_start(walk_sources *src, int nready) {
+    walk *w = malloc(sizeof *w);
+    assert(w);
+    w->src = *src;
+    w->nfound = 0;
+    w->error = 0;
+    pthread_mutex_init(&w->lock, 0);
+    w->spare = 0;
+    queue_init(&w->names, NAMES);
+    queue_init(&w->ready, nready);
+    if (pthread_create(&w->walker, 0, walker, w) != 0 ||
+	pthread_create(&w->reader, 0, reader, w) != 0) {
+	perror("pthread_create");
+	exit(1);
+    }
+    return w;
+}
+
+/* The next file, or a null pointer when there are no
+   more.  May be called from many threads at once. */
+walk_file *walk_next(walk *w) {
+    return queue_get(&w->ready);
+}
+
+/* Done with f, whose fd must be closed by now.  Its
+   name may be taken first, if it is set to a null
+   pointer. */
+void walk_done(walk *w, walk_file *f) {
+    if (!f->name)
+	f->nname = 0;
+    pthread_mutex_lock(&w->lock);
+    f->next = w->spare;
+    w->spare = f;
+    pthread_mutex_unlock(&w->lock);
+}
+
+/* Once walk_next() has returned a null pointer, clean up.
+   Returns the number of files found, or -1 if the list of
+   names couldn't be read. */
+int walk_finish(walk *w) {
+    int n;
+    pthread_join(w->walker, 0);
+    pthread_join(w->reader, 0);
+    n = w->error ? -1 : w->nfound;
+    while (w->spare) {
+	walk_file *f = w->spare;
+	w->spare = f->next;
+	free(f->name);
+	free(f);
+    }
+    pthread_mutex_destroy(&w->lock);
+    queue_free(&w->names);
+    queue_free(&w->ready);
+    free(w);
+    return n;
+}
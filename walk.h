@@ -0,0 +1,34 @@
+/*
+ * Copyright © 2005-2009 Bart Massey
+ * ALL RIGHTS RESERVED
+ * [This program is licensed under the "3-clause ('new') BSD License"]
+ * Please see the file COPYING in the source
+ * distribution of this software for license terms.
+ */
+
+/* where the files to hash come from */
+typedef struct walk_sources {
+    int nname;
+    char **name;            /* files named outright */
+    int ndir;
+    char **dir;             /* trees to walk */
+    char *files_from;       /* NUL-terminated names, "-" for stdin */
+    char *skip;             /* suffix of names to leave out */
+} walk_sources;
+
+/* a file ready to hash: index counts from 0 in the order
+   the files were found; fd is -1 if it couldn't be opened */
+typedef struct walk_file {
+    int index;
+    char *name;
+    int fd;
+    size_t nname;           /* room at name */
+    struct walk_file *next; /* in the list of spares */
+} walk_file;
+
+typedef struct walk walk;
+
+extern walk *walk_start(walk_sources *src, int nready);
+extern walk_file *walk_next(walk *w);
+extern void walk_done(walk *w, walk_file *f);
+extern int walk_finish(walk *w);